@@ -362,6 +362,42 @@ template <typename _PointType> struct TBoundingBox {
         return ray.mint <= farT && nearT <= ray.maxt;
     }
 
+    /**
+     * \brief Check whether a ray segment intersects the bounding box and
+     * return the distance at which it enters the box
+     *
+     * \c nearT is clamped to the start of the segment, so that it can be
+     * compared against a \c ray.maxt that shrinks later on.
+     */
+    bool rayIntersect(const Ray3f &ray, float &nearT) const {
+        nearT = ray.mint;
+        float farT = ray.maxt;
+
+        for (int i=0; i<3; i++) {
+            float origin = ray.o[i];
+            float minVal = min[i], maxVal = max[i];
+
+            if (ray.d[i] == 0) {
+                if (origin < minVal || origin > maxVal)
+                    return false;
+            } else {
+                float t1 = (minVal - origin) * ray.dRcp[i];
+                float t2 = (maxVal - origin) * ray.dRcp[i];
+
+                if (t1 > t2)
+                    std::swap(t1, t2);
+
+                nearT = std::max(t1, nearT);
+                farT = std::min(t2, farT);
+
+                if (!(nearT <= farT))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
     /// Return the overlapping region of the bounding box and an unbounded ray
     bool rayIntersect(const Ray3f &ray, float &nearT, float &farT) const {
         nearT = -std::numeric_limits<float>::infinity();
@@ -21,6 +21,7 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <map>
 
 NORI_NAMESPACE_BEGIN
 
@@ -42,11 +43,30 @@ public:
     Bitmap(const Vector2i &size = Vector2i(0, 0))
         : Base(size.y(), size.x()) { }
 
-    /// Load an OpenEXR file with the specified filename
-    Bitmap(const std::string &filename);
+    /// Additional string attributes stored in the header of an EXR file
+    typedef std::map<std::string, std::string> Metadata;
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void save(const std::string &filename);
+    /**
+     * \brief Load an OpenEXR file with the specified filename
+     *
+     * If \c metadata is given, the string attributes of the header
+     * are stored in it. The bitmap contains the data window of the file,
+     * whose position within the display window and the size of the latter
+     * are stored in \c offset and \c displaySize if given.
+     */
+    Bitmap(const std::string &filename, Metadata *metadata = nullptr,
+           Point2i *offset = nullptr, Vector2i *displaySize = nullptr);
+
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename
+     *
+     * The entries of \c metadata are added to the header of the file
+     * as string attributes. For a crop of a larger image, \c offset and
+     * \c displaySize specify the data window within the display window
+     * (a display size of zero: the size of the bitmap).
+     */
+    void save(const std::string &filename, const Metadata &metadata = Metadata(),
+              const Point2i &offset = Point2i(0, 0), const Vector2i &displaySize = Vector2i(0, 0));
 
     /// Save the bitmap as a PNG file with the specified filename
     void saveToLDR(const std::string &filename);
@@ -25,12 +25,36 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
-#include <tbb/mutex.h>
+#include <nori/bitmap.h>
+#include <tbb/spin_rw_mutex.h>
+#include <atomic>
 
-#define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
+#define NORI_BLOCK_SIZE 32 /* Default block size used for parallelization */
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief The border of an image block, i.e. the part of its filter
+ * footprint that reaches into the neighboring blocks
+ *
+ * Once the interior of a block has been merged (see \ref ImageBlock::putInterior()),
+ * this is all that needs to be kept until the borders are merged after the pass.
+ * The four strips around the block are stored one after another.
+ *
+ * The pixels within the border size of the edges of a block also receive
+ * samples of its neighbors, so their moments can only be computed once the
+ * neighbors have been rendered as well (see \ref ImageBlock::putEdgeMoments()).
+ * For that purpose, \c samples holds the border strips followed by the
+ * strips along the edges inside of the block for every single sample.
+ */
+struct BlockBorder {
+    Point2i offset;               ///< Offset of the block (without border) within the image
+    Vector2i size;                ///< Size of the block (without border)
+    int borderSize = 0;
+    std::vector<Color4f> pixels;  ///< Border strips, summed over all samples
+    std::vector<Color4f> samples; ///< Border and edge strips of every sample (see \ref ImageBlock::setDeferEdgeMoments())
+};
+
 /**
  * \brief Weighted pixel storage for a rectangular subregion of an image
  *
@@ -44,9 +68,15 @@ NORI_NAMESPACE_BEGIN
  * this region. For that reason, this class also stores information about
  * a small border region around the rectangle, whose size depends on the
  * properties of the reconstruction filter.
+ *
+ * Optionally, the block also keeps running per-pixel moments (sum and sum of
+ * squares) of single-sample pixel values along with per-pixel sample counts,
+ * which are needed to estimate the variance of every pixel while rendering.
  */
 class ImageBlock : public Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
+    typedef Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Base;
+
     /**
      * Create a new image block of the specified maximum size
      * \param size
@@ -54,13 +84,17 @@ public:
      * \param filter
      *     Samples will be convolved with the image reconstruction
      *     filter provided here.
+     * \param trackMoments
+     *     Also store per-pixel moments for variance estimation
      */
-    ImageBlock(const Vector2i &size, const ReconstructionFilter *filter);
+    ImageBlock(const Vector2i &size, const ReconstructionFilter *filter,
+               bool trackMoments = false);
     
     /// Release all memory
     ~ImageBlock();
 
-    void init(const Vector2i &size, const ReconstructionFilter *filter);
+    void init(const Vector2i &size, const ReconstructionFilter *filter,
+              bool trackMoments = false);
     
     /// Configure the offset of the block within the main image
     void setOffset(const Point2i &offset) { m_offset = offset; }
@@ -91,19 +125,120 @@ public:
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
+    /// Does this block keep per-pixel moments?
+    bool hasMoments() const { return m_sum.size() > 0; }
+
+    /**
+     * \brief Return the estimated variance of every pixel value
+     *
+     * Requires per-pixel moments. The result is the variance of the
+     * pixel mean, i.e. the sample variance (with Bessel's correction)
+     * divided by the number of samples of the pixel.
+     */
+    Bitmap *toVarianceBitmap() const;
+
+    /**
+     * \brief Return the mean relative standard error of a region
+     *
+     * The standard error of each pixel (square root of its variance) is
+     * divided by the pixel value and averaged over all pixels of the
+     * region given in image coordinates. Pixels with less than two
+     * samples count as infinitely bad. Requires per-pixel moments.
+     */
+    float getRelativeError(const Point2i &offset, const Vector2i &size) const;
+
+    /**
+     * \brief Return the mean relative variance of a region
+     *
+     * Like \ref getRelativeError(), but averages the variance of each
+     * pixel divided by its squared value.
+     */
+    float getRelativeVariance(const Point2i &offset, const Vector2i &size) const;
+
+    /// Return the number of samples recorded for a pixel (requires moments)
+    uint32_t getSampleCount(int x, int y) const { return m_sampleCounts.coeff(y, x); }
+
+    /**
+     * \brief Write the contents of the block (including the moments) to a stream
+     *
+     * The data is stored in raw binary form and can only be restored by
+     * \ref loadState() into a block of the same size.
+     */
+    void saveState(std::ostream &stream) const;
+
+    /// Restore the contents written by \ref saveState()
+    void loadState(std::istream &stream);
+
     /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    void clear();
 
     /// Record a sample with the given position and radiance value
     void put(const Point2f &pos, const Color3f &value);
 
+    /// Merge another image block into this one (see \ref putInterior() and \ref putBorder())
+    void put(ImageBlock &b) { putInterior(b); putBorder(b); }
+
+    /**
+     * \brief Merge the pixels of another block without its border
+     *
+     * The blocks of a \ref BlockGenerator don't overlap, so merging
+     * distinct blocks never writes the same pixels. This also merges the
+     * per-pixel moments. Callers must hold the shared lock (see
+     * \ref lockShared()) while other threads (e.g. the GUI) may read this block.
+     */
+    void putInterior(const ImageBlock &b);
+
+    /**
+     * \brief Merge the border of another block, i.e. the part of its
+     * filter footprint that reaches into the neighboring blocks
+     *
+     * This function is not thread-safe. Merging the borders of a pass in a
+     * fixed order after all interiors makes the result independent of the
+     * order in which the blocks were rendered.
+     */
+    void putBorder(const ImageBlock &b);
+
+    /// Merge a border that was copied by \ref getBorder()
+    void putBorder(const BlockBorder &b);
+
+    /// Copy the border of this block (and the samples near its edges), to merge it later on
+    void getBorder(BlockBorder &border) const;
+
     /**
-     * \brief Merge another image block into this one
+     * \brief Update the moments of the pixels near the edges of a block
      *
-     * During the merge operation, this function locks 
-     * the destination block using a mutex.
+     * Every sample of the block is combined with the sample of the same
+     * index (within the pass) of every neighbor, i.e. the moments are
+     * those of a rendering in which the blocks weren't separated.
+     *
+     * \param b
+     *     Border of a block whose accumulation block deferred the
+     *     moments of its edges (see \ref setDeferEdgeMoments())
+     * \param neighbors
+     *     Borders of the neighbors of the block that were rendered
+     *     at the same time (see \ref BlockGenerator::getNeighbors())
      */
-    void put(ImageBlock &b);
+    void putEdgeMoments(const BlockBorder &b, const std::vector<const BlockBorder *> &neighbors);
+
+    /**
+     * \brief Add a block that contains a single sample per pixel
+     *
+     * Besides adding the weighted samples, this updates the per-pixel
+     * moments (if any) with the normalized pixel values of \c b. The two
+     * blocks must have the same offset and size.
+     */
+    void accumulate(const ImageBlock &b);
+
+    /**
+     * \brief Keep the samples near the edges of the block (see
+     * \ref BlockBorder) instead of adding them to the moments
+     *
+     * This is required for blocks whose neighbors are rendered separately,
+     * because the neighbors contribute to these pixels through their
+     * border. Blocks that render the samples of their border themselves
+     * (i.e. with a counter-based sampler) don't need it.
+     */
+    void setDeferEdgeMoments(bool defer) { m_deferEdgeMoments = defer; }
 
     /// Lock the image block (using an internal mutex)
     inline void lock() const { m_mutex.lock(); }
@@ -111,6 +246,18 @@ public:
     /// Unlock the image block
     inline void unlock() const { m_mutex.unlock(); }
 
+    /**
+     * \brief Lock the image block for merging a block that doesn't overlap
+     * with those of other threads (see \ref putInterior())
+     *
+     * Any number of threads can hold the shared lock at the same time,
+     * but not while another thread holds the lock of \ref lock().
+     */
+    inline void lockShared() const { m_mutex.lock_read(); }
+
+    /// Unlock the image block after \ref lockShared()
+    inline void unlockShared() const { m_mutex.unlock(); }
+
     /// Return a human-readable string summary
     std::string toString() const;
 protected:
@@ -123,58 +270,93 @@ protected:
     float *m_weightsY = nullptr;
     float m_lookupFactor = 0;
     uint32_t m_blockId; // id given by the block generator
-    mutable tbb::mutex m_mutex;
+    mutable tbb::spin_rw_mutex m_mutex;
+    Bitmap m_sum;        ///< Per-pixel sum of single-sample values (without border)
+    Bitmap m_sumSquared; ///< Per-pixel sum of squared single-sample values
+    Eigen::Array<uint32_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> m_sampleCounts; ///< Per-pixel sample counts
+    bool m_deferEdgeMoments = false;
+    std::vector<Color4f> m_edgeSamples; ///< Border and edge strips of every accumulated sample
 };
 
 /**
- * \brief Spiraling block generator
+ * \brief Cost-aware block scheduler
  *
- * This class can be used to chop up an image into many small
- * rectangular blocks suitable for parallel rendering. The blocks
- * are ordered in spiraling pattern so that the center is
- * rendered first.
+ * This class chops up an image into many small rectangular blocks suitable
+ * for parallel rendering in passes. It records how long every block took to
+ * render in earlier passes and hands out the most expensive blocks first, so
+ * that no thread picks up an expensive block at the end of a pass while all
+ * others are idle. Expensive blocks are handed out individually, whereas
+ * cheap ones are bundled into larger tasks. As long as nothing has been
+ * measured (i.e. in the first pass), the blocks are ordered in a spiraling
+ * pattern so that the center is rendered first.
+ *
+ * The order of a pass is computed up front, so that handing out tasks only
+ * requires incrementing an atomic cursor.
  */
 class BlockGenerator {
 public:
     /**
      * \brief Create a block generator with
+     * \param offset
+     *      Offset of the region that should be split into blocks (e.g.
+     *      a crop window) within the image
      * \param size
-     *      Size of the image that should be split into blocks
+     *      Size of the region that should be split into blocks
      * \param blockSize
      *      Maximum size of the individual blocks
      */
-    BlockGenerator(const Vector2i &size, int blockSize);
-    
+    BlockGenerator(const Point2i &offset, const Vector2i &size, int blockSize);
+
+    /// Return the total number of blocks
+    int getBlockCount() const { return (int) m_spiral.size(); }
+
+    /// Configure the offset, size and ID of an image block to those of a block
+    void getBlock(uint32_t blockId, ImageBlock &block) const;
+
+    /// Return the IDs of the (up to eight) blocks that share an edge or a corner with a block
+    void getNeighbors(uint32_t blockId, std::vector<uint32_t> &neighbors) const;
+
     /**
-     * \brief Return the next block to be rendered
-     *
-     * This function is thread-safe
+     * \brief Compute the order of the next pass
      *
-     * \return \c false if there were no more blocks
+     * \param samples
+     *      Number of samples that every block receives in the pass
+     *      (blocks with zero samples are skipped)
+     * \param threadCount
+     *      Number of threads that render the pass
+     * \return The number of tasks of the pass
      */
-    bool next(ImageBlock &block);
+    int beginPass(const std::vector<uint32_t> &samples, int threadCount);
 
     /**
-     * \brief Reset to the first block
+     * \brief Return the next task of the current pass, i.e. the range
+     * <tt>[begin, end)</tt> of IDs of the blocks to render
      *
-     * This function is thread-safe
+     * This function is thread-safe and lock-free
+     *
+     * \return \c false if there were no more tasks
      */
-    void reset();
+    bool next(const uint32_t *&begin, const uint32_t *&end);
 
-    /// Return the total number of blocks
-    int getBlockCount() const { return m_blocksLeft; }
+    /**
+     * \brief Record that rendering \c samples samples of a block took
+     * \c time milliseconds (e.g. of a \ref Timer)
+     *
+     * This function is thread-safe as long as the blocks are distinct
+     */
+    void addCost(uint32_t blockId, uint32_t samples, double time);
 protected:
     enum EDirection { ERight = 0, EDown, ELeft, EUp };
 
-    Point2i m_block;
     Vector2i m_numBlocks;
+    Point2i m_offset;
     Vector2i m_size;
     int m_blockSize;
-    int m_numSteps;
-    int m_blocksLeft;
-    int m_stepsLeft;
-    int m_direction;
-    tbb::mutex m_mutex;
+    std::vector<uint32_t> m_spiral;   ///< All blocks in spiraling order
+    std::vector<float> m_cost;        ///< Measured time per sample of every block in milliseconds (0: unknown)
+    std::vector<uint32_t> m_order;    ///< Blocks of the current pass, grouped into tasks
+    std::vector<uint32_t> m_tasks;    ///< Index of the first block of every task in m_order (plus the end)
+    std::atomic<size_t> m_cursor;     ///< Next task to hand out
 };
 
 NORI_NAMESPACE_END
@@ -38,6 +38,13 @@ NORI_NAMESPACE_BEGIN
  * "Fast and Parallel Construction of SAH-based Bounding Volume Hierarchies"
  * by Ingo Wald (Proc. IEEE/EG Symposium on Interactive Ray Tracing, 2007)
  *
+ * For traversal, the binary tree is collapsed into a 4-wide tree, whose
+ * nodes store the bounding boxes of their children in SoA layout so that
+ * a ray is tested against all four of them at once (using SSE, if
+ * available). The leaves refer to a copy of their triangles that is
+ * stored in the same order with precomputed edges, again in SoA blocks of
+ * four (see \ref setPrecomputeTriangles()).
+ *
  * \author Wenzel Jakob
  */
 class BVH {
@@ -59,8 +66,31 @@ public:
      */
     void addShape(Shape *shape);
 
-    /// Build the BVH
-    void build();
+    /**
+     * \brief Keep a precomputed copy of the triangles in the order of the
+     * leaves (the default), or only refer to the indexed meshes
+     *
+     * The copy stores the first vertex and two edges of every triangle and
+     * takes about 40 bytes per triangle (see \ref getTriangleStorageSize()),
+     * but avoids two indirections per vertex and tests four triangles at
+     * once. This function can only be used before \ref build() is called.
+     */
+    void setPrecomputeTriangles(bool precompute) { m_precomputeTriangles = precompute; }
+
+    /// Return the memory used by the precomputed triangles in bytes
+    size_t getTriangleStorageSize() const { return m_triangleStorageSize; }
+
+    /**
+     * \brief Build the BVH
+     *
+     * \param useCache
+     *    Look up the tree in the asset cache and store it there. Rebuilds
+     *    of animated scenes don't, as every frame has a tree of its own.
+     */
+    void build(bool useCache = true);
+
+    /// Build the BVH again after the registered shapes changed
+    void rebuild();
 
     /**
      * \brief Intersect a ray against all shapes registered
@@ -80,6 +110,33 @@ public:
     bool rayIntersect(const Ray3f &ray, Intersection &its, 
         bool shadowRay = false) const;
 
+    /// Maximum number of rays that are traced together by \ref rayIntersect() for ray streams
+    static const uint32_t PacketSize = 16;
+
+    /**
+     * \brief Intersect a stream of rays against all shapes registered
+     * with the BVH
+     *
+     * Consecutive rays are traced together in packets of up to
+     * \ref PacketSize rays: every node is fetched once for all active rays
+     * of a packet, each child is tested against four rays at once (using
+     * SSE, if available) and the packet only descends into a child with
+     * the rays that enter it. Once a single ray is left, it continues on
+     * its own. This pays off for coherent rays, e.g. the camera rays of
+     * neighboring pixels or their shadow rays towards a small light, and
+     * yields the same results as tracing every ray on its own (up to the
+     * choice between primitives that are hit at exactly the same distance).
+     *
+     * \param hits
+     *    Set to \c true for every ray that was found to intersect a shape
+     *
+     * \param its
+     *    Receives the intersection of every ray that hit a shape. May be
+     *    \c nullptr for shadow rays, whose intersections are never filled.
+     */
+    void rayIntersect(const Ray3f *rays, uint32_t count, Intersection *its,
+        bool *hits, bool shadowRay = false) const;
+
     /// Return the total number of shapes registered with the BVH
     uint32_t getShapeCount() const { return (uint32_t) m_shapes.size(); }
 
@@ -98,28 +155,27 @@ public:
     }
 
 protected:
-    /**
-     * \brief Compute the shape and primitive indices corresponding to
-     * a primitive index used by the underlying generic BVH implementation. 
-     */
-    uint32_t findShape(uint32_t &idx) const {
-        auto it = std::lower_bound(m_shapeOffset.begin(), m_shapeOffset.end(), idx+1) - 1;
-        idx -= *it;
-        return (uint32_t) (it - m_shapeOffset.begin());
-    }
+    /// Reference to a primitive: the registered shape and its index within that shape
+    struct PrimitiveRef {
+        uint32_t shape;
+        uint32_t index;
+    };
 
-    //// Return an axis-aligned bounding box containing the given primitive
+    //// Return an axis-aligned bounding box containing the given primitive (only during the build)
     BoundingBox3f getBoundingBox(uint32_t index) const {
-        uint32_t shapeIdx = findShape(index);
-        return m_shapes[shapeIdx]->getBoundingBox(index);
+        const PrimitiveRef &prim = m_primitives[index];
+        return m_shapes[prim.shape]->getBoundingBox(prim.index);
     }
-    
-    //// Return the centroid of the given primitive
+
+    //// Return the centroid of the given primitive (only during the build)
     Point3f getCentroid(uint32_t index) const {
-        uint32_t shapeIdx = findShape(index);
-        return m_shapes[shapeIdx]->getCentroid(index);
+        const PrimitiveRef &prim = m_primitives[index];
+        return m_shapes[prim.shape]->getCentroid(prim.index);
     }
 
+    /// Build the tree of \ref build() from scratch
+    void buildTree();
+
     /// Compute internal tree statistics
     std::pair<float, uint32_t> statistics(uint32_t index = 0) const;
 
@@ -162,12 +218,95 @@ protected:
             return leaf.start + leaf.size;
         }
     };
+
+    /**
+     * \brief 4-wide BVH node in 128 bytes
+     *
+     * The bounds of the four children are stored per coordinate: \c bounds[0..2]
+     * hold the minima and \c bounds[3..5] the maxima of x, y and z. An inner child
+     * has a \c count of zero and refers to another wide node, a leaf refers to the
+     * primitives <tt>[child, child + count)</tt>. Unused slots have an empty
+     * (inverted) bounding box, which no ray intersects.
+     */
+    struct WideNode {
+        float bounds[6][4];
+        uint32_t child[4];
+        uint32_t count[4];
+    };
+
+    /**
+     * \brief Four triangles in SoA layout: the first vertex and the two
+     * edges starting from it, per coordinate
+     *
+     * \c count is the number of valid triangles (the others are degenerate),
+     * or zero for the blocks of primitives that are not triangles.
+     */
+    struct TriangleBlock {
+        float p0[3][4];
+        float edge1[3][4];
+        float edge2[3][4];
+        uint32_t count;
+    };
+
+    /**
+     * \brief Collapse the subtree of a binary node into 4-wide nodes
+     *
+     * Inner children are repeatedly replaced by their own children (the
+     * one with the largest surface area first) until a node has four
+     * children or only leaves are left.
+     *
+     * \return The index of the wide node of the subtree
+     */
+    uint32_t collapse(const std::vector<BVHNode> &nodes, uint32_t index);
+
+    /**
+     * \brief Copy the triangles of all leaves into \ref TriangleBlock instances
+     *
+     * The primitives are reordered so that every leaf starts at a multiple
+     * of four with its mesh triangles, which fill whole blocks (the last
+     * one is padded), followed by all other primitives.
+     */
+    void precomputeTriangles();
+
+    /**
+     * \brief Intersect a ray with the primitives <tt>[start, end)</tt> of a leaf
+     *
+     * On a hit, \c ray.maxt, \c its.t, \c its.uv, \c its.mesh and the
+     * primitive index \c f are updated (unless \c shadowRay is set, which
+     * stops at the first hit). \c primitiveTests is only counted with
+     * \c NORI_STATS.
+     *
+     * \return \c true if the ray intersects one of the primitives
+     */
+    bool intersectLeaf(uint32_t start, uint32_t end, Ray3f &ray, Intersection &its,
+        uint32_t &f, bool shadowRay, uint64_t &primitiveTests) const;
+
+    /**
+     * \brief Traverse the subtree of a child of a wide node (see \ref WideNode)
+     * with a single ray, updating it like \ref intersectLeaf()
+     *
+     * \c nodeVisits and \c primitiveTests are only counted with \c NORI_STATS.
+     */
+    bool traverse(uint32_t child, uint32_t count, Ray3f &ray, Intersection &its, uint32_t &f,
+        bool shadowRay, uint64_t &nodeVisits, uint64_t &primitiveTests) const;
+
+    /// Trace a packet of up to \ref PacketSize rays (see \ref rayIntersect())
+    void rayIntersectPacket(const Ray3f *rays, uint32_t count, Intersection *its,
+        bool *hits, bool shadowRay) const;
 private:
     std::vector<Shape *> m_shapes;       ///< List of meshes registered with the BVH
     std::vector<uint32_t> m_shapeOffset; ///< Index of the first triangle for each shape
-    std::vector<BVHNode> m_nodes;       ///< BVH nodes
-    std::vector<uint32_t> m_indices;    ///< Index references by BVH nodes
+    std::vector<BVHNode> m_nodes;       ///< Binary BVH nodes (only during the build)
+    std::vector<WideNode> m_wideNodes;  ///< 4-wide BVH nodes used for traversal
+    std::vector<uint32_t> m_indices;    ///< Primitive indices sorted into the leaves (only during the build)
+    std::vector<PrimitiveRef> m_primitives; ///< Primitives referenced by the leaves (during the build: all primitives in order)
+    std::vector<TriangleBlock> m_triangles; ///< Precomputed triangles, one block per four entries of \c m_primitives
+    bool m_precomputeTriangles = true;  ///< Keep the precomputed triangles?
+    size_t m_triangleStorageSize = 0;   ///< Memory used by the precomputed triangles and the padding of the leaves
     BoundingBox3f m_bbox;               ///< Bounding box of the entire BVH
+#if defined(NORI_STATS)
+    std::vector<uint32_t> m_shapeTypes; ///< Statistics index of the type of every shape
+#endif
 };
 
 NORI_NAMESPACE_END
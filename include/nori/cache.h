@@ -0,0 +1,127 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_CACHE_H)
+#define __NORI_CACHE_H
+
+#include <nori/common.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Cache of loaded assets (meshes, textures, volume grids, BVHs)
+ * that are identified by a hash of their content
+ *
+ * The render daemon (<tt>nori --daemon</tt>) enables the cache, so that
+ * consecutive jobs which use the same assets skip loading them. When the
+ * cache is disabled (the default), \ref get() simply calls the loader.
+ */
+class AssetCache {
+public:
+    /// Enable or disable the cache (disabling releases all entries)
+    void setEnabled(bool enabled);
+
+    /// Is the cache enabled?
+    bool isEnabled() const { return m_enabled; }
+
+    /**
+     * \brief Return the asset of the given kind (e.g. "mesh") and content
+     * hash, calling \c load if it isn't in the cache yet
+     *
+     * \c key is only evaluated if the cache is enabled, since hashing the
+     * content of large files takes time.
+     */
+    template <typename T>
+    std::shared_ptr<T> get(const std::string &kind, const std::function<uint64_t()> &key,
+                           const std::function<std::shared_ptr<T>()> &load) {
+        if (!m_enabled)
+            return load();
+
+        std::pair<std::string, uint64_t> id(kind, key());
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(id);
+            if (it != m_entries.end()) {
+                it->second.lastJob = m_job;
+                m_hits++;
+                return std::static_pointer_cast<T>(it->second.asset);
+            }
+        }
+
+        std::shared_ptr<T> asset = load();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[id] = Entry { asset, m_job };
+        m_misses++;
+        return asset;
+    }
+
+    /**
+     * \brief Start a new job
+     *
+     * Assets that weren't used by any of the last \c keepJobs jobs are
+     * released.
+     */
+    void beginJob(int keepJobs = 4);
+
+    /// Return a summary of the cache activity since the last \ref beginJob()
+    std::string getStatistics() const;
+
+    /// Compute a 64 bit FNV-1a hash of a memory region, continuing from \c hash
+    static uint64_t hash(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+    /// Compute the hash of the content of a file
+    static uint64_t hashFile(const std::string &filename);
+
+private:
+    struct Entry {
+        std::shared_ptr<void> asset;
+        uint64_t lastJob;
+    };
+
+    bool m_enabled = false;
+    uint64_t m_job = 0;
+    size_t m_hits = 0, m_misses = 0;
+    mutable std::mutex m_mutex;
+    std::map<std::pair<std::string, uint64_t>, Entry> m_entries;
+};
+
+/// Return the process-wide asset cache
+extern AssetCache *getAssetCache();
+
+/// 8 bit image decoded by stb_image
+struct LDRImage {
+    unsigned char *data = nullptr;
+    int width = 0, height = 0, channels = 0;
+
+    ~LDRImage();
+};
+
+/**
+ * \brief Load an 8 bit image (PNG, JPEG, ..) through the asset cache
+ *
+ * On failure, the \c data pointer of the result is \c nullptr.
+ */
+extern std::shared_ptr<LDRImage> loadLDRImage(const std::string &filename);
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_CACHE_H */
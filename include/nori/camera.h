@@ -59,9 +59,39 @@ public:
         const Point2f &apertureSample,
         float contribution) const = 0;
 
+    /**
+     * \brief Move the camera to the given frame of an animation
+     *
+     * The default implementation does nothing (static camera).
+     */
+    virtual void setFrame(float frame) { }
+
     /// Return the size of the output image in pixels
     const Vector2i &getOutputSize() const { return m_outputSize; }
 
+    /**
+     * \brief Change the size of the output image (e.g. for a preview)
+     *
+     * The field of view is preserved, so the aspect ratio should be kept.
+     */
+    virtual void setOutputSize(const Vector2i &size) { m_outputSize = size; }
+
+    /// Return the offset of the crop window (the part of the image that is rendered)
+    const Point2i &getCropOffset() const { return m_cropOffset; }
+
+    /// Return the size of the crop window (by default, the size of the output image)
+    Vector2i getCropSize() const { return m_cropSize == Vector2i::Zero() ? m_outputSize : m_cropSize; }
+
+    /// Only render the given window of the image (a size of zero renders all of it)
+    void setCropWindow(const Point2i &offset, const Vector2i &size) {
+        if (size != Vector2i::Zero() && ((offset.array() < 0).any() || (size.array() <= 0).any() ||
+                ((offset + size).array() > m_outputSize.array()).any()))
+            throw NoriException("The crop window (offset %s, size %s) is not within the %ix%i image!",
+                                offset.toString(), size.toString(), m_outputSize.x(), m_outputSize.y());
+        m_cropOffset = size == Vector2i::Zero() ? Point2i(0, 0) : offset;
+        m_cropSize = size;
+    }
+
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
@@ -72,6 +102,8 @@ public:
     virtual EClassType getClassType() const override { return ECamera; }
 protected:
     Vector2i m_outputSize;
+    Point2i m_cropOffset = Point2i(0, 0);
+    Vector2i m_cropSize = Vector2i(0, 0); ///< Size of the crop window (zero: the entire image)
     ReconstructionFilter *m_rfilter;
 };
 
@@ -20,6 +20,8 @@
 #define __NORI_INTEGRATOR_H
 
 #include <nori/object.h>
+#include <nori/shape.h>
+#include <functional>
 
 NORI_NAMESPACE_BEGIN
 
@@ -54,6 +56,56 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Sample the incident radiance along a ray whose first
+     * intersection has already been found
+     *
+     * The renderer traces the camera rays of neighboring pixels together
+     * in packets and passes on their intersections, provided that the
+     * integrator supports this (see \ref acceptsIntersections() and
+     * \ref LiPacket()). The estimate must be the same as the one of
+     * \ref Li() for this ray.
+     *
+     * \param its
+     *    The first intersection of the ray, or \c nullptr if the ray
+     *    doesn't hit anything
+     */
+    virtual Color3f LiFromIntersection(const Scene *scene, Sampler *sampler,
+            const Ray3f &ray, const Intersection *its) const {
+        return Li(scene, sampler, ray);
+    }
+
+    /**
+     * \brief Sample the incident radiance along a packet of camera rays
+     *
+     * The renderer hands over the camera rays of up to \ref BVH::PacketSize
+     * neighboring pixels along with their intersections, so that coherent
+     * secondary rays (e.g. shadow rays towards a small light) can be traced
+     * together as well. The default implementation calls
+     * \ref LiFromIntersection() for every ray.
+     *
+     * \param its
+     *    The first intersections of the rays, which are only valid where
+     *    \c hits is set
+     * \param startSample
+     *    Prepares the sampler for the estimate of ray \c i (i.e. the sample
+     *    values after its camera sample), which must be called before any
+     *    sample values of the ray are drawn
+     * \param Li
+     *    Receives the estimates
+     */
+    virtual void LiPacket(const Scene *scene, Sampler *sampler, const Ray3f *rays,
+            const Intersection *its, const bool *hits, uint32_t count,
+            const std::function<void(uint32_t)> &startSample, Color3f *Li) const {
+        for (uint32_t i = 0; i < count; ++i) {
+            startSample(i);
+            Li[i] = LiFromIntersection(scene, sampler, rays[i], hits[i] ? &its[i] : nullptr);
+        }
+    }
+
+    /// Does this integrator make use of the intersections passed to \ref LiFromIntersection() and \ref LiPacket()?
+    virtual bool acceptsIntersections() const { return false; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
@@ -93,16 +93,16 @@ public:
     Normal3f getInterpolatedNormal(uint32_t index, const Vector3f & bc) const;
 
     /// Return a pointer to the vertex positions
-    const MatrixXf &getVertexPositions() const { return m_V; }
+    const Eigen::Map<const MatrixXf> &getVertexPositions() const { return m_V; }
 
     /// Return a pointer to the vertex normals (or \c nullptr if there are none)
-    const MatrixXf &getVertexNormals() const { return m_N; }
+    const Eigen::Map<const MatrixXf> &getVertexNormals() const { return m_N; }
 
     /// Return a pointer to the texture coordinates (or \c nullptr if there are none)
-    const MatrixXf &getVertexTexCoords() const { return m_UV; }
+    const Eigen::Map<const MatrixXf> &getVertexTexCoords() const { return m_UV; }
 
     /// Return a pointer to the triangle vertex index list
-    const MatrixXu &getIndices() const { return m_F; }
+    const Eigen::Map<const MatrixXu> &getIndices() const { return m_F; }
 
 
     /// Return the name of this mesh
@@ -115,12 +115,20 @@ protected:
     /// Create an empty mesh
     Mesh();
 
+    /**
+     * \brief Let the mesh refer to the given vertices and faces
+     *
+     * They aren't copied (e.g. the geometry in the \ref AssetCache is shared
+     * by all meshes that use it), so the subclass has to keep them alive.
+     */
+    void setGeometry(const MatrixXf &V, const MatrixXf &N, const MatrixXf &UV, const MatrixXu &F);
+
 protected:
     std::string m_name;                  ///< Identifying name
-    MatrixXf      m_V;                   ///< Vertex positions
-    MatrixXf      m_N;                   ///< Vertex normals
-    MatrixXf      m_UV;                  ///< Vertex texture coordinates
-    MatrixXu      m_F;                   ///< Faces
+    Eigen::Map<const MatrixXf> m_V;      ///< Vertex positions
+    Eigen::Map<const MatrixXf> m_N;      ///< Vertex normals
+    Eigen::Map<const MatrixXf> m_UV;     ///< Vertex texture coordinates
+    Eigen::Map<const MatrixXu> m_F;      ///< Faces
 
     DiscretePDF m_pdf;
 };
@@ -0,0 +1,101 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_PROFILER_H)
+#define __NORI_PROFILER_H
+
+#include <nori/common.h>
+#include <atomic>
+#include <map>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Timeline of profiling zones (see \ref ProfileZone)
+ *
+ * While a recording is active, every zone that ends adds an event to a
+ * buffer of the current thread. \ref end() writes the events of all threads
+ * to a JSON file in the Chrome trace event format, which can be opened in
+ * chrome://tracing or https://ui.perfetto.dev. When no recording is active,
+ * a zone only costs a check of an atomic flag.
+ */
+class Profiler {
+public:
+    /// Start a new recording (discarding the events of a previous one)
+    static void begin();
+
+    /// Stop the recording and write its events to a trace file
+    static void end(const std::string &filename);
+
+    /// Stop the recording without writing it (the events are kept until the next \ref begin())
+    static void stop();
+
+    /// Return the summed durations (in microseconds) of the recorded zones by name
+    static std::map<std::string, int64_t> getTotals();
+
+    /// Is a recording active?
+    static bool isActive() { return m_active.load(std::memory_order_relaxed); }
+
+    /// Name the current thread in the timeline (e.g. "render")
+    static void setThreadName(const std::string &name);
+
+    /// Return the time in microseconds since the start of the recording
+    static int64_t now();
+
+    /// Add a zone of the current thread to the recording
+    static void record(const char *name, const std::string &detail, int64_t start, int64_t end);
+
+private:
+    static std::atomic<bool> m_active;
+};
+
+/**
+ * \brief Scoped profiling zone: records the time between its construction
+ * and destruction on the timeline of the current thread
+ *
+ * \c name must be a string literal. The optional \c detail (e.g. a
+ * filename) is shown in the arguments of the event.
+ */
+class ProfileZone {
+public:
+    ProfileZone(const char *name)
+        : m_name(name), m_start(Profiler::isActive() ? Profiler::now() : -1) { }
+
+    ProfileZone(const char *name, const std::string &detail)
+        : m_name(name), m_start(Profiler::isActive() ? Profiler::now() : -1) {
+        if (m_start >= 0)
+            m_detail = detail;
+    }
+
+    ~ProfileZone() {
+        if (m_start >= 0 && Profiler::isActive())
+            Profiler::record(m_name, m_detail, m_start, Profiler::now());
+    }
+
+private:
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+    const char *m_name;
+    std::string m_detail;
+    int64_t m_start;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_PROFILER_H */
@@ -126,6 +126,12 @@ public:
 
     /// Get a transform property, and use a default value if it does not exist
     Transform getTransform(const std::string &name, const Transform &defaultValue) const;
+
+    /// Add a keyframe to an animated transform property
+    void addKeyframe(const std::string &name, float frame, const Transform &value);
+
+    /// Get an animated transform property (without keyframes if it does not exist)
+    AnimatedTransform getAnimatedTransform(const std::string &name) const;
 private:
     /* Custom variant data type (stores one of boolean/integer/float/...) */
     struct Property {
@@ -158,6 +164,7 @@ private:
     };
 
     std::map<std::string, Property> m_properties;
+    std::map<std::string, AnimatedTransform> m_animatedTransforms;
 };
 
 NORI_NAMESPACE_END
@@ -26,17 +26,194 @@
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Per-job settings that override what the scene file specifies
+ *
+ * The defaults reproduce the behavior of opening a scene in the GUI.
+ */
+struct RenderOptions {
+    /// Output EXR file (an empty string derives it from the scene filename)
+    std::string outputName;
+
+    /// Number of samples per pixel (a value <= 0 keeps the sampler's setting)
+    int sampleCount = 0;
+
+    /// Seed offset of the sampler (a negative value keeps the sampler's setting)
+    int seed = -1;
+
+    /**
+     * Replace the sampler of the scene by the counter-based "deterministic"
+     * sampler, which makes the image bit-identical for any thread count,
+     * block size, schedule and distribution to workers
+     */
+    bool deterministic = false;
+
+    /**
+     * Scale factor of the resolution of the camera (e.g. 0.5 for a quick
+     * preview at half the width and height)
+     */
+    float resolutionScale = 1.f;
+
+    /**
+     * Crop window in pixels (after scaling the resolution): only this part
+     * of the image is rendered and stored, as the data window of EXR files
+     * that have the size of the entire image. A size of zero keeps the crop
+     * window of the camera (by default, the entire image).
+     */
+    Point2i cropOffset = Point2i(0, 0);
+    Vector2i cropSize = Vector2i(0, 0);
+
+    /// Also write a "_variance.exr" file with the per-pixel variance estimate
+    bool computeVariance = true;
+
+    /**
+     * Also write a "_cost.exr" file with the wall-clock time spent on every
+     * pixel in microseconds, summed over its samples. Builds with
+     * NORI_ENABLE_STATS additionally write the BVH node visits of every
+     * pixel to "_traversal.exr". After resuming a rendering, the cost only
+     * covers the samples rendered since then.
+     */
+    bool computeCost = false;
+
+    /**
+     * Write the ray and shading statistics (see \ref Statistics) to this
+     * JSON file. They are only available if Nori was built with
+     * NORI_ENABLE_STATS, in which case they are always printed.
+     */
+    std::string statsName;
+
+    /**
+     * Record a timeline of loading, BVH construction, preprocessing and
+     * the rendering of every block (see \ref Profiler) and write it to
+     * this file in the Chrome trace event format
+     */
+    std::string traceName;
+
+    /**
+     * Number of consecutive samples that a task renders for one block
+     * before merging them into the image. Larger values mean fewer
+     * synchronization points, smaller values more frequent GUI updates.
+     */
+    int samplesPerTask = 8;
+
+    /**
+     * Size of the blocks that the image is split into. Every block has its
+     * own sample generator, so this also determines the random numbers.
+     */
+    int blockSize = NORI_BLOCK_SIZE;
+
+    /**
+     * Number of threads that render the image (0: all cores). This only
+     * determines how the work of a pass is split into tasks; the thread
+     * pool itself is set up by the caller.
+     */
+    int threadCount = 0;
+
+    /**
+     * Adaptive sampling: after \c adaptiveBaseSamples samples per pixel,
+     * only blocks whose mean relative error (see \ref ImageBlock::getRelativeError())
+     * is above \c adaptiveThreshold receive further samples, until they
+     * drop below it or reach the sample count of the sampler.
+     */
+    bool adaptive = false;
+
+    /// Samples per pixel that every block receives before adaptive refinement
+    int adaptiveBaseSamples = 16;
+
+    /// Target relative error of adaptive sampling
+    float adaptiveThreshold = 0.02f;
+
+    /**
+     * Wall-clock budget of the rendering in seconds (0: unlimited). Once it
+     * is exceeded, rendering stops as if it had been interrupted and the
+     * samples rendered so far are written.
+     */
+    float timeBudget = 0.f;
+
+    /**
+     * Stop once the mean relative variance of the image (see
+     * \ref ImageBlock::getRelativeVariance()) drops below this value,
+     * which is checked after every pass (0: disabled)
+     */
+    float targetVariance = 0.f;
+
+    /**
+     * With a time budget or a target variance, the sample count of the
+     * sampler no longer bounds the rendering; passes continue until one of
+     * the limits is hit. An explicit \c sampleCount still acts as a cap.
+     */
+    bool isProgressive() const { return timeBudget > 0 || targetVariance > 0; }
+
+    /**
+     * Interval in seconds between checkpoints (0: disabled). A checkpoint
+     * "<output>.checkpoint" is written at the end of the first pass after
+     * the interval has elapsed and removed once the rendering completes
+     * (which includes exhausting the time budget).
+     */
+    float checkpointInterval = 0.f;
+
+    /**
+     * Interval in seconds between snapshots of the image in progress
+     * (0: disabled). At the end of the first pass after the interval has
+     * elapsed, the normalized image (and the variance, if computed) is
+     * written to the output files, which the final image then replaces.
+     */
+    float snapshotInterval = 0.f;
+
+    /// Also write a snapshot after every \c snapshotPasses passes (0: disabled)
+    int snapshotPasses = 0;
+
+    /**
+     * Continue the rendering from its checkpoint. Without a time budget
+     * (which ends the rendering after a pass that depends on the timing),
+     * the result is identical to that of an uninterrupted rendering with
+     * the same settings.
+     */
+    bool resume = false;
+
+    /**
+     * Distribute the blocks to worker processes (see \ref renderWorker())
+     * that connect to this TCP port instead of rendering them locally
+     * (0: render locally). The result is identical to a local rendering.
+     */
+    int listenPort = 0;
+
+    /**
+     * Sequence rendering: render the frames [firstFrame, lastFrame] of the
+     * animation (see \ref Scene::setFrame()) one after another into
+     * "<output>_<frame>.exr" files. Without a valid range, only the
+     * (static) scene is rendered.
+     */
+    int firstFrame = 0, lastFrame = -1;
+
+    /// Is this a sequence rendering?
+    bool isSequence() const { return lastFrame >= firstFrame; }
+};
+
 class RenderThread {
 
 public:
     RenderThread(ImageBlock & block);
     ~RenderThread();
 
-    void renderScene(const std::string & filename);
+    /**
+     * \brief Load a scene and start rendering it asynchronously
+     *
+     * \return \c false if the file did not describe a scene (e.g. a test),
+     *     in which case nothing is rendered
+     */
+    bool renderScene(const std::string & filename,
+                     const RenderOptions & options = RenderOptions());
 
     bool isBusy();
     void stopRendering();
 
+    /// Block until the current rendering job (if any) has finished
+    void waitUntilDone();
+
+    /// Return \c true if the last rendering job was aborted by an error
+    bool hasFailed() const { return m_failed; }
+
     float getProgress();
 
 protected:
@@ -45,9 +222,20 @@ protected:
     std::thread m_render_thread;
     std::atomic<int> m_render_status; // 0: free, 1: busy, 2: interruption, 3: done
     std::atomic<float> m_progress;
+    std::atomic<bool> m_failed;
 
 };
 
+/**
+ * \brief Render blocks for a coordinator (see \ref RenderOptions::listenPort)
+ *
+ * Opens \c connectionCount connections to the coordinator at \c address
+ * ("host:port"), each of which renders one block at a time, and returns once
+ * the coordinator has finished the rendering. The scene is loaded from the
+ * path that the coordinator sends, so it must be accessible to the worker.
+ */
+extern void renderWorker(const std::string &address, int connectionCount);
+
 NORI_NAMESPACE_END
 
 #endif //__NORI_RENDER_H
@@ -89,6 +89,31 @@ public:
     /// Advance to the next sample
     virtual void advance() = 0;
 
+    /**
+     * \brief Start generating the given sample of a pixel
+     *
+     * This function is called before the camera ray of every pixel sample
+     * is generated. Counter-based samplers (see \ref isCounterBased())
+     * derive all values of the sample from these arguments, the default
+     * implementation does nothing.
+     *
+     * \param dimension
+     *     Number of values of the sample to skip, e.g. to continue a sample
+     *     after its camera ray (only supported by counter-based samplers)
+     */
+    virtual void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension = 0) { }
+
+    /**
+     * \brief Are the sample values a pure function of the pixel, the sample
+     * index and the dimension (i.e. independent of \ref prepare())?
+     *
+     * The renderer then also renders the samples of the pixels in the
+     * border of every block, so that a block contains all samples that
+     * contribute to its pixels. This makes the image bit-identical for any
+     * block size, thread count, schedule and distribution to workers.
+     */
+    virtual bool isCounterBased() const { return false; }
+
     /// Retrieve the next component value from the current sample
     virtual float next1D() = 0;
 
@@ -98,6 +123,35 @@ public:
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /// Override the number of configured pixel samples
+    virtual void setSampleCount(size_t sampleCount) { m_sampleCount = sampleCount; }
+
+    /**
+     * \brief Return the seed offset of the sample generator
+     *
+     * Renderings of the same scene with different seeds are statistically
+     * independent, so that they can be merged (see <tt>nori-merge</tt>).
+     */
+    virtual uint32_t getSeed() const { return m_seed; }
+
+    /// Override the seed offset of the sample generator
+    virtual void setSeed(uint32_t seed) { m_seed = seed; }
+
+    /**
+     * \brief Write the current state of the sample generator to a stream
+     *
+     * Restoring it with \ref loadState() continues with exactly the same
+     * sample values, which allows to resume an interrupted rendering.
+     */
+    virtual void saveState(std::ostream &stream) const {
+        throw NoriException("%s does not support saving its state!", toString());
+    }
+
+    /// Restore a state written by \ref saveState()
+    virtual void loadState(std::istream &stream) {
+        throw NoriException("%s does not support loading its state!", toString());
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -105,6 +159,7 @@ public:
     virtual EClassType getClassType() const override { return ESampler; }
 protected:
     size_t m_sampleCount;
+    uint32_t m_seed = 0;
 };
 
 NORI_NAMESPACE_END
@@ -52,12 +52,18 @@ public:
     /// Return a pointer to the scene's camera
     const Camera *getCamera() const { return m_camera; }
 
+    /// Return a pointer to the scene's camera
+    Camera *getCamera() { return m_camera; }
+
     /// Return a pointer to the scene's sample generator (const version)
     const Sampler *getSampler() const { return m_sampler; }
 
     /// Return a pointer to the scene's sample generator
     Sampler *getSampler() { return m_sampler; }
 
+    /// Replace the scene's sample generator (the scene takes ownership)
+    void setSampler(Sampler *sampler);
+
     /// Return a reference to an array containing all shapes
     const std::vector<Shape *> &getShapes() const { return m_shapes; }
 
@@ -135,6 +141,36 @@ public:
         return m_bvh->rayIntersect(ray, its, true);
     }
 
+    /**
+     * \brief Intersect a stream of rays against all triangles stored
+     * in the scene
+     *
+     * Coherent rays (e.g. the camera rays of neighboring pixels) are
+     * traced together in packets, see \ref BVH::rayIntersect().
+     *
+     * \param its
+     *    Receives the intersection of every ray that hit a shape
+     *
+     * \param hits
+     *    Set to \c true for every ray for which an intersection was found
+     */
+    void rayIntersect(const Ray3f *rays, uint32_t count, Intersection *its, bool *hits) const {
+        m_bvh->rayIntersect(rays, count, its, hits, false);
+    }
+
+    /**
+     * \brief Test a stream of shadow rays for occlusion
+     *
+     * Like \ref rayIntersect(const Ray3f &) const for every ray, but
+     * coherent rays (e.g. towards a small light) are traced together.
+     *
+     * \param occluded
+     *    Set to \c true for every ray that is occluded
+     */
+    void rayIntersect(const Ray3f *rays, uint32_t count, bool *occluded) const {
+        m_bvh->rayIntersect(rays, count, nullptr, occluded, true);
+    }
+
     /**
      * \brief Return an axis-aligned box that bounds the scene
      */
@@ -150,6 +186,15 @@ public:
      */
     virtual void activate() override;
 
+    /**
+     * \brief Move the camera and the shapes to the given frame of an animation
+     *
+     * The BVH is only rebuilt if the geometry changed.
+     *
+     * \return \c true if the geometry changed
+     */
+    bool setFrame(float frame);
+
     /// Add a child object to the scene (meshes, integrators etc.)
     virtual void addChild(NoriObject *obj) override;
 
@@ -122,6 +122,13 @@ public:
     const BSDF *getBSDF() const { return m_bsdf; }
 
 
+    /**
+     * \brief Move the shape to the given frame of an animation
+     *
+     * \return \c true if the geometry changed (i.e. the BVH must be rebuilt)
+     */
+    virtual bool setFrame(float frame) { return false; }
+
     /// Return the total number of primitives in this shape
     virtual uint32_t getPrimitiveCount() const { return 1; }
 
@@ -0,0 +1,92 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_SOCKET_H)
+#define __NORI_SOCKET_H
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Minimal stream socket that exchanges length-prefixed messages
+ *
+ * This is used to distribute rendering work to other processes. All
+ * functions throw a \ref NoriException when the underlying system call
+ * fails. Only POSIX systems are supported.
+ */
+class Socket {
+public:
+    /// Create an invalid socket
+    Socket() { }
+
+    /// Close the socket
+    ~Socket() { close(); }
+
+    Socket(Socket &&other) : m_fd(other.m_fd) { other.m_fd = -1; }
+    Socket &operator=(Socket &&other);
+
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    /// Listen for TCP connections on the given port of all interfaces
+    static Socket listen(int port);
+
+    /// Connect to a TCP server
+    static Socket connect(const std::string &host, int port);
+
+    /// Listen for local connections on a Unix domain socket at the given path
+    static Socket listenLocal(const std::string &path);
+
+    /// Connect to a Unix domain socket
+    static Socket connectLocal(const std::string &path);
+
+    /**
+     * \brief Wait for a connection on a listening socket
+     *
+     * \return An invalid socket if the listening socket was shut down
+     */
+    Socket accept();
+
+    /// Send a message
+    void send(const std::string &message);
+
+    /**
+     * \brief Receive a message
+     *
+     * \return \c false if the connection was closed before a new message
+     */
+    bool receive(std::string &message);
+
+    /// Stop all communication, which also wakes up a thread that waits in \ref accept()
+    void shutdown();
+
+    /// Close the socket
+    void close();
+
+    /// Is this a valid (i.e. open) socket?
+    bool isValid() const { return m_fd >= 0; }
+private:
+    explicit Socket(int fd) : m_fd(fd) { }
+
+    int m_fd = -1;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SOCKET_H */
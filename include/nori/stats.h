@@ -0,0 +1,140 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_STATS_H)
+#define __NORI_STATS_H
+
+#include <nori/common.h>
+#include <typeinfo>
+
+/* =======================================================================
+ *   Ray and shading statistics. The counters only exist if Nori is built
+ *   with NORI_STATS defined (CMake option NORI_ENABLE_STATS), otherwise
+ *   all of the following macros expand to nothing.
+ * ======================================================================= */
+
+#if defined(NORI_STATS)
+/// Add \c value to a counter of the current thread (see \ref Statistics::ECounter)
+#define NORI_STATS_ADD(counter, value) (nori::Statistics::local().counters[nori::Statistics::counter] += (value))
+/// Count a call of Shape::rayIntersect() for the shape type with the given index
+#define NORI_STATS_SHAPE_TEST(type) (nori::Statistics::local().shapeTests[type]++)
+/// Record the length (number of bounces) of a finished path
+#define NORI_STATS_PATH_LENGTH(length) nori::Statistics::addPathLength(length)
+/// Code that is only compiled if the statistics are enabled (e.g. local counters)
+#define NORI_STATS_ONLY(...) __VA_ARGS__
+#else
+#define NORI_STATS_ADD(counter, value) ((void) 0)
+#define NORI_STATS_SHAPE_TEST(type) ((void) 0)
+#define NORI_STATS_PATH_LENGTH(length) ((void) 0)
+#define NORI_STATS_ONLY(...)
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Per-thread counters of rays, BVH traversal steps, media tracking
+ * steps and path lengths
+ *
+ * Every thread increments its own counters without any synchronization.
+ * They are summed up by \ref getSummary() once the rendering is done.
+ * Use the \c NORI_STATS_* macros to update them, which compile to nothing
+ * unless \c NORI_STATS is defined.
+ */
+class Statistics {
+public:
+    enum ECounter {
+        ECameraRays = 0,         ///< Rays generated by the camera
+        EIntersectionRays,       ///< Closest-hit queries of the BVH
+        EShadowRays,             ///< Occlusion queries of the BVH
+        EBVHNodeVisits,          ///< Wide BVH nodes whose children were tested
+        EPrimitiveTests,         ///< Ray-primitive intersection tests
+        EMediumSampleSteps,      ///< Delta tracking steps of HeterogeneousMedium::sample()
+        EMediumTrSteps,          ///< Delta tracking steps of HeterogeneousMedium::Tr()
+        EPaths,                  ///< Paths traced by the path tracers
+        ERussianRoulette,        ///< Paths terminated by Russian roulette
+        ECounterCount
+    };
+
+    /// Maximal number of distinct shape types
+    static const int MaxShapeTypes = 16;
+
+    /// Path lengths from this value on share the last histogram bin
+    static const int MaxPathLength = 32;
+
+    /// Counters of one thread
+    struct Counters {
+        uint64_t counters[ECounterCount];
+        uint64_t shapeTests[MaxShapeTypes];
+        uint64_t pathLengths[MaxPathLength + 1];
+    };
+
+    /// Sum of the counters of all threads
+    struct Summary : Counters {
+        std::vector<std::string> shapeTypes; ///< Names of the shape types
+        double renderTime = 0;              ///< Render time in seconds
+
+        /// Return a human-readable report
+        std::string toString() const;
+
+        /// Return the statistics as a JSON object
+        std::string toJSON() const;
+    };
+
+    /// Are the statistics compiled in?
+    static bool isEnabled();
+
+    /// Return the counters of the current thread
+    static Counters &local() {
+        Counters *&counters = localPointer();
+        if (!counters)
+            counters = registerThread();
+        return *counters;
+    }
+
+    /// Record the length (number of bounces) of a finished path
+    static void addPathLength(int length) {
+        Counters &counters = local();
+        counters.counters[EPaths]++;
+        counters.pathLengths[std::min(std::max(length, 0), (int) MaxPathLength)]++;
+    }
+
+    /// Return the index of a shape class (e.g. of a \ref Mesh) for \c NORI_STATS_SHAPE_TEST
+    static uint32_t getShapeType(const std::type_info &type);
+
+    /// Reset the counters of all threads (no thread may render meanwhile)
+    static void reset();
+
+    /// Sum up the counters of all threads (no thread may render meanwhile)
+    static Summary getSummary();
+
+    /// Name of a counter in reports
+    static const char *getName(ECounter counter);
+
+private:
+    static Counters *&localPointer() {
+        /* Constant initialization, so that accessing it doesn't need a guard */
+        static thread_local Counters *counters = nullptr;
+        return counters;
+    }
+
+    static Counters *registerThread();
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_STATS_H */
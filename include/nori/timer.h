@@ -25,7 +25,7 @@
 NORI_NAMESPACE_BEGIN
 
 /**
- * \brief Simple timer with millisecond precision
+ * \brief Simple timer with sub-millisecond precision
  *
  * This class is convenient for collecting performance data
  */
@@ -40,8 +40,7 @@ public:
     /// Return the number of milliseconds elapsed since the timer was last reset
     double elapsed() const {
         auto now = std::chrono::system_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-        return (double) duration.count();
+        return std::chrono::duration<double, std::milli>(now - start).count();
     }
 
     /// Like \ref elapsed(), but return a human-readable string
@@ -52,9 +51,9 @@ public:
     /// Return the number of milliseconds elapsed since the timer was last reset and then reset it
     double lap() {
         auto now = std::chrono::system_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+        double duration = std::chrono::duration<double, std::milli>(now - start).count();
         start = now;
-        return (double) duration.count();
+        return duration;
     }
 
     /// Like \ref lap(), but return a human-readable string
@@ -21,6 +21,7 @@
 
 #include <nori/common.h>
 #include <nori/ray.h>
+#include <map>
 
 NORI_NAMESPACE_BEGIN
 
@@ -96,6 +97,27 @@ private:
     Eigen::Matrix4f m_inverse;
 };
 
+/**
+ * \brief Transformation that is animated by keyframes
+ *
+ * Between two keyframes, the translation and the scale are interpolated
+ * linearly and the rotation spherically. Before the first and after the
+ * last keyframe, the transformation stays constant.
+ */
+class AnimatedTransform {
+public:
+    /// Add a keyframe at the given frame number
+    void addKeyframe(float frame, const Transform &trafo);
+
+    /// Are there any keyframes?
+    bool isAnimated() const { return !m_keyframes.empty(); }
+
+    /// Return the transformation at the given (fractional) frame
+    Transform eval(float frame) const;
+private:
+    std::map<float, Transform> m_keyframes;
+};
+
 NORI_NAMESPACE_END
 
 #endif /* __NORI_TRANSFORM_H */
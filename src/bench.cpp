@@ -0,0 +1,247 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/block.h>
+#include <nori/render.h>
+#include <nori/profiler.h>
+#include <nori/stats.h>
+#include <filesystem/path.h>
+#include <tbb/task_scheduler_init.h>
+#include <fstream>
+
+/*
+ * End-to-end rendering benchmark: renders a fixed set of scenes headlessly
+ * with a fixed sample count, resolution, seed and thread count, and reports
+ * the time spent loading, building the BVH, preprocessing and rendering
+ * together with the throughput in rays and samples per second.
+ *
+ * The durations are taken from the profiling zones (see \ref Profiler), the
+ * ray counts from the statistics (see \ref Statistics). This program is
+ * linked to the same object files as nori, so the ray counts are only
+ * reported when those are built with NORI_STATS (NORI_ENABLE_STATS).
+ */
+
+using namespace nori;
+
+namespace {
+    struct BenchScene {
+        const char *name;
+        const char *filename;    ///< Relative to the scene directory
+        int sampleCount;
+        float resolutionScale;
+    };
+
+    const BenchScene benchScenes[] = {
+        { "cbox",     "pa4/cbox/cbox_path_mis.xml",             16, 0.5f  },
+        { "table",    "pa4/table/table_path_mis.xml",           16, 0.5f  },
+        { "clocks",   "pa4/clocks/clocks.xml",                  4,  0.5f  },
+        { "veach_mi", "pa3/veach_mi/veach_mis.xml",             16, 0.5f  },
+        { "medium",   "Project/Medium/cbox_hetero-grid.xml",    4,  0.5f  },
+        { "final",    "Project/Final/final-image.xml",          4,  0.25f }
+    };
+
+    struct BenchResult {
+        std::string name, error;
+        Vector2i size = Vector2i::Zero();
+        int sampleCount = 0;
+        double loadTime = 0, bvhTime = 0, preprocessTime = 0, renderTime = 0;
+        uint64_t rays = 0;
+
+        double samplesPerSecond() const {
+            return renderTime > 0 ? (double) size.prod() * sampleCount / renderTime : 0;
+        }
+
+        double mraysPerSecond() const {
+            return renderTime > 0 ? rays / renderTime * 1e-6 : 0;
+        }
+    };
+
+    /// Render one scene and collect the durations of its phases
+    BenchResult run(const BenchScene &scene, const std::string &sceneDir,
+                    const std::string &imageDir, int threadCount) {
+        BenchResult result;
+        result.name = scene.name;
+        result.sampleCount = scene.sampleCount;
+
+        RenderOptions options;
+        options.outputName = (filesystem::path(imageDir) / filesystem::path(
+            tfm::format("bench_%s.exr", scene.name))).str();
+        options.sampleCount = scene.sampleCount;
+        options.resolutionScale = scene.resolutionScale;
+        options.seed = 0;
+        options.threadCount = threadCount;
+        options.computeVariance = false;
+
+        ImageBlock block(Vector2i(720, 720), nullptr);
+        RenderThread renderThread(block);
+        Profiler::begin();
+        try {
+            if (!renderThread.renderScene((filesystem::path(sceneDir) / filesystem::path(scene.filename)).str(), options))
+                result.error = "not a scene";
+            renderThread.waitUntilDone();
+            if (renderThread.hasFailed())
+                result.error = "the rendering failed";
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        }
+        Profiler::stop();
+        if (!result.error.empty())
+            return result;
+
+        std::map<std::string, int64_t> totals = Profiler::getTotals();
+        /* The BVH is built while the scene is loaded */
+        result.bvhTime = totals["BVH::build"] * 1e-6;
+        result.loadTime = totals["loadFromXML"] * 1e-6 - result.bvhTime;
+        result.preprocessTime = totals["Integrator::preprocess"] * 1e-6;
+        result.renderTime = totals["pass"] * 1e-6;
+        result.size = block.getSize();
+
+#if defined(NORI_STATS)
+        Statistics::Summary summary = Statistics::getSummary();
+        result.rays = summary.counters[Statistics::EIntersectionRays] +
+                      summary.counters[Statistics::EShadowRays];
+#endif
+        return result;
+    }
+
+    std::string toJSON(const std::vector<BenchResult> &results, int threadCount) {
+        std::ostringstream oss;
+        oss << "{" << endl
+            << "  \"threads\": " << threadCount << "," << endl
+            << "  \"scenes\": [" << endl;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult &r = results[i];
+            oss << "    {\"name\": \"" << r.name << "\", ";
+            if (!r.error.empty()) {
+                std::string error;
+                for (char c : r.error)
+                    error += c == '"' || c == '\\' ? std::string("\\") + c : std::string(1, c);
+                oss << "\"error\": \"" << error << "\"}";
+            } else {
+                oss << tfm::format("\"width\": %i, \"height\": %i, \"spp\": %i, "
+                        "\"loadTime\": %.4f, \"bvhBuildTime\": %.4f, \"preprocessTime\": %.4f, \"renderTime\": %.4f, ",
+                        r.size.x(), r.size.y(), r.sampleCount, r.loadTime, r.bvhTime, r.preprocessTime, r.renderTime);
+#if defined(NORI_STATS)
+                oss << tfm::format("\"rays\": %i, \"mraysPerSecond\": %.4f, ", r.rays, r.mraysPerSecond());
+#endif
+                oss << tfm::format("\"samplesPerSecond\": %.1f}", r.samplesPerSecond());
+            }
+            oss << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        oss << "  ]" << endl << "}" << endl;
+        return oss.str();
+    }
+
+    void printUsage() {
+        cout << "Syntax: nori-bench [options] [scene names]" << endl
+             << endl
+             << "Renders a fixed set of scenes and reports the load, BVH build, preprocessing" << endl
+             << "and render times, Mrays/s (with NORI_ENABLE_STATS) and samples/s. Scenes:";
+        for (const BenchScene &scene : benchScenes)
+            cout << " " << scene.name;
+        cout << endl << endl
+             << "Options:" << endl
+             << "   --threads <count>    Number of render threads (default: all cores)" << endl
+             << "   --scenes <dir>       Directory of the scenes (default: scenes)" << endl
+             << "   --images <dir>       Directory of the rendered images (default: .)" << endl
+             << "   --json <file.json>   Write the results as JSON" << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    int threadCount = tbb::task_scheduler_init::default_num_threads();
+    std::string sceneDir = "scenes", imageDir = ".", jsonName;
+    std::vector<const BenchScene *> selection;
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string &arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "--threads" && hasValue) {
+                threadCount = toInt(args[++i]);
+                if (threadCount <= 0)
+                    throw NoriException("The thread count must be positive!");
+            } else if (arg == "--scenes" && hasValue) {
+                sceneDir = args[++i];
+            } else if (arg == "--images" && hasValue) {
+                imageDir = args[++i];
+            } else if (arg == "--json" && hasValue) {
+                jsonName = args[++i];
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else {
+                const BenchScene *match = nullptr;
+                for (const BenchScene &scene : benchScenes)
+                    if (arg == scene.name)
+                        match = &scene;
+                if (!match)
+                    throw NoriException("Unknown scene or option \"%s\"", arg);
+                selection.push_back(match);
+            }
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+
+    if (selection.empty())
+        for (const BenchScene &scene : benchScenes)
+            selection.push_back(&scene);
+
+    /* Always use the same number of threads, so that results are comparable */
+    tbb::task_scheduler_init init(threadCount);
+
+    std::vector<BenchResult> results;
+    for (const BenchScene *scene : selection) {
+        cout << endl << "=== " << scene->name << " ===" << endl;
+        results.push_back(run(*scene, sceneDir, imageDir, threadCount));
+        if (!results.back().error.empty())
+            cerr << "Skipping \"" << scene->name << "\": " << results.back().error << endl;
+    }
+
+    cout << endl << tfm::format("%-10s %10s %6s %9s %9s %9s %9s %9s %12s", "scene", "size", "spp",
+        "load", "bvh", "preproc", "render", "Mrays/s", "samples/s") << endl;
+    for (const BenchResult &r : results) {
+        if (!r.error.empty()) {
+            cout << tfm::format("%-10s (failed)", r.name) << endl;
+            continue;
+        }
+#if defined(NORI_STATS)
+        std::string mrays = tfm::format("%.2f", r.mraysPerSecond());
+#else
+        std::string mrays = "-";
+#endif
+        cout << tfm::format("%-10s %10s %6i %8.3fs %8.3fs %8.3fs %8.3fs %9s %12.0f", r.name,
+            tfm::format("%ix%i", r.size.x(), r.size.y()), r.sampleCount, r.loadTime, r.bvhTime,
+            r.preprocessTime, r.renderTime, mrays, r.samplesPerSecond()) << endl;
+    }
+
+    if (!jsonName.empty()) {
+        std::ofstream file(jsonName);
+        file << toJSON(results, threadCount);
+        if (!file) {
+            cerr << "Error: unable to write \"" << jsonName << "\"" << endl;
+            return 2;
+        }
+        cout << "Wrote the results to \"" << jsonName << "\"" << endl;
+    }
+    return 0;
+}
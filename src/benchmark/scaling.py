@@ -0,0 +1,63 @@
+import os
+import re
+import argparse
+import subprocess
+import tempfile
+
+
+UNITS = {"ms": 1e-3, "s": 1.0, "m": 60.0, "h": 3600.0}
+
+
+def parse_render_time(output: str) -> float:
+    # "Rendering .. done. (took 21.6s)", see timeString() in src/common.cpp
+    match = re.search(r"Rendering \.\. done\. \(took ([0-9.]+)(ms|s|m|h)\)", output)
+    if match is None:
+        raise RuntimeError(f"Could not find the render time in the output of nori:\n{output}")
+    return float(match.group(1)) * UNITS[match.group(2)]
+
+
+def thread_counts(max_threads: int):
+    counts = []
+    n = 1
+    while n < max_threads:
+        counts.append(n)
+        n *= 2
+    counts.append(max_threads)
+    return counts
+
+
+def render(nori: str, scene: str, threads: int, spp: int, output: str) -> float:
+    result = subprocess.run(
+        [nori, "--render", scene, "--threads", str(threads), "--spp", str(spp),
+         "--no-variance", "--output", output],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"nori failed with exit code {result.returncode}:\n{result.stdout}")
+    return parse_render_time(result.stdout)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure how rendering scales from 1 to N threads")
+    parser.add_argument('--nori', type=str, default="build/nori", help="Path to the nori executable")
+    parser.add_argument('--scene', type=str, default="scenes/pa4/cbox/cbox_path_mis.xml", help="Scene to render")
+    parser.add_argument('--spp', type=int, default=64, help="Samples per pixel")
+    parser.add_argument('--threads', type=int, default=os.cpu_count(), help="Maximum number of threads (N)")
+    parser.add_argument('--repeat', type=int, default=3, help="Renders per thread count (the fastest one is reported)")
+    args = parser.parse_args()
+
+    print(f"Scaling of '{args.scene}' at {args.spp} spp")
+    print(f"{'threads':>8} {'time [s]':>10} {'speedup':>8} {'efficiency':>10}")
+
+    with tempfile.TemporaryDirectory() as directory:
+        output = os.path.join(directory, "scaling.exr")
+        baseline = None
+        for threads in thread_counts(args.threads):
+            seconds = min(render(args.nori, args.scene, threads, args.spp, output) for _ in range(args.repeat))
+            if baseline is None:
+                baseline = seconds
+            speedup = baseline / seconds
+            print(f"{threads:>8} {seconds:>10.2f} {speedup:>8.2f} {speedup / threads:>10.0%}")
+
+
+if __name__ == '__main__':
+    main()
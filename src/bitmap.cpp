@@ -30,13 +30,26 @@
 
 NORI_NAMESPACE_BEGIN
 
-Bitmap::Bitmap(const std::string &filename) {
+Bitmap::Bitmap(const std::string &filename, Metadata *metadata, Point2i *offset, Vector2i *displaySize) {
     Imf::InputFile file(filename.c_str());
     const Imf::Header &header = file.header();
     const Imf::ChannelList &channels = header.channels();
 
+    if (metadata) {
+        for (Imf::Header::ConstIterator it = header.begin(); it != header.end(); ++it) {
+            const Imf::StringAttribute *attribute = dynamic_cast<const Imf::StringAttribute *>(&it.attribute());
+            if (attribute)
+                (*metadata)[it.name()] = attribute->value();
+        }
+    }
+
     Imath::Box2i dw = file.header().dataWindow();
     resize(dw.max.y - dw.min.y + 1, dw.max.x - dw.min.x + 1);
+    const Imath::Box2i &display = header.displayWindow();
+    if (offset)
+        *offset = Point2i(dw.min.x - display.min.x, dw.min.y - display.min.y);
+    if (displaySize)
+        *displaySize = Vector2i(display.max.x - display.min.x + 1, display.max.y - display.min.y + 1);
 
     cout << "Reading a " << cols() << "x" << rows() << " OpenEXR file from \""
          << filename << "\"" << endl;
@@ -69,7 +82,8 @@ Bitmap::Bitmap(const std::string &filename) {
            pixelStride = 3 * compStride,
            rowStride = pixelStride * cols();
 
-    char *ptr = reinterpret_cast<char *>(data());
+    /* The slices are addressed with the coordinates of the data window */
+    char *ptr = reinterpret_cast<char *>(data()) - dw.min.x * (ptrdiff_t) pixelStride - dw.min.y * (ptrdiff_t) rowStride;
 
     Imf::FrameBuffer frameBuffer;
     frameBuffer.insert(ch_r, Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
@@ -79,12 +93,19 @@ Bitmap::Bitmap(const std::string &filename) {
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::save(const std::string &filename) {
+void Bitmap::save(const std::string &filename, const Metadata &metadata,
+                  const Point2i &offset, const Vector2i &displaySize) {
     cout << "Writing a " << cols() << "x" << rows() 
          << " OpenEXR file to \"" << filename << "\"" << endl;
 
-    Imf::Header header((int) cols(), (int) rows());
+    Vector2i display = displaySize == Vector2i::Zero() ? Vector2i((int) cols(), (int) rows()) : displaySize;
+    Imath::Box2i displayWindow(Imath::V2i(0, 0), Imath::V2i(display.x() - 1, display.y() - 1));
+    Imath::Box2i dataWindow(Imath::V2i(offset.x(), offset.y()),
+                            Imath::V2i(offset.x() + (int) cols() - 1, offset.y() + (int) rows() - 1));
+    Imf::Header header(displayWindow, dataWindow);
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    for (auto const &entry : metadata)
+        header.insert(entry.first, Imf::StringAttribute(entry.second));
 
     Imf::ChannelList &channels = header.channels();
     channels.insert("R", Imf::Channel(Imf::FLOAT));
@@ -96,7 +117,7 @@ void Bitmap::save(const std::string &filename) {
            pixelStride = 3 * compStride,
            rowStride = pixelStride * cols();
 
-    char *ptr = reinterpret_cast<char *>(data());
+    char *ptr = reinterpret_cast<char *>(data()) - offset.x() * (ptrdiff_t) pixelStride - offset.y() * (ptrdiff_t) rowStride;
     frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); 
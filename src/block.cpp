@@ -24,8 +24,8 @@
 
 NORI_NAMESPACE_BEGIN
 
-ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter) {
-    init(size,filter);
+ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter, bool trackMoments) {
+    init(size, filter, trackMoments);
 }
 
 ImageBlock::~ImageBlock() {
@@ -35,7 +35,7 @@ ImageBlock::~ImageBlock() {
 }
 
 
-void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter) {
+void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter, bool trackMoments) {
     m_offset = Point2i(0, 0);
     m_size = size;
     m_borderSize = 0;
@@ -71,6 +71,20 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
 
     /* Allocate space for pixels and border regions */
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
+
+    /* Moments are only needed for the pixels without the border */
+    Vector2i momentsSize = trackMoments ? size : Vector2i(0, 0);
+    m_sum.resize(momentsSize.y(), momentsSize.x());
+    m_sumSquared.resize(momentsSize.y(), momentsSize.x());
+    m_sampleCounts.resize(momentsSize.y(), momentsSize.x());
+}
+
+void ImageBlock::clear() {
+    setConstant(Color4f());
+    m_sum.setConstant(Color3f(0.0f));
+    m_sumSquared.setConstant(Color3f(0.0f));
+    m_sampleCounts.setZero();
+    m_edgeSamples.clear();
 }
 
 Bitmap *ImageBlock::toBitmap() const {
@@ -81,6 +95,107 @@ Bitmap *ImageBlock::toBitmap() const {
     return result;
 }
 
+/// Variance of the mean of a pixel with \c n samples (zero if it can't be estimated)
+static Color3f pixelVariance(const Color3f &sum, const Color3f &sumSquared, uint32_t n) {
+    if (n < 2)
+        return Color3f(0.0f);
+    // var[p] = (sample variance) * 1/n = ((ss/n - (s/n)^2) * (n/(n-1))) * 1/n = (ss - s^2/n) / ((n-1) * n)
+    float samplesFactor = (float) n * (float) (n - 1);
+    return (sumSquared - sum * sum / (float) n) / samplesFactor;
+}
+
+Bitmap *ImageBlock::toVarianceBitmap() const {
+    if (!hasMoments())
+        throw NoriException("ImageBlock::toVarianceBitmap(): the block has no moments!");
+
+    Bitmap *result = new Bitmap(m_size);
+    for (int y=0; y<m_size.y(); ++y)
+        for (int x=0; x<m_size.x(); ++x)
+            result->coeffRef(y, x) = pixelVariance(m_sum.coeff(y, x),
+                m_sumSquared.coeff(y, x), m_sampleCounts.coeff(y, x));
+    return result;
+}
+
+/**
+ * Average the relative deviation of all pixels in a region. The value of each
+ * pixel is offset slightly to keep (nearly) black pixels from dominating.
+ */
+template <typename Func> static float averageRelative(const Bitmap &sum, const Bitmap &sumSquared,
+        const Eigen::Array<uint32_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> &sampleCounts,
+        const Point2i &start, const Vector2i &size, const Func &func) {
+    double result = 0;
+    for (int y=start.y(); y<start.y() + size.y(); ++y) {
+        for (int x=start.x(); x<start.x() + size.x(); ++x) {
+            uint32_t n = sampleCounts.coeff(y, x);
+            if (n < 2)
+                return std::numeric_limits<float>::infinity();
+            float mean = std::abs((sum.coeff(y, x) / (float) n).mean()) + 1e-3f;
+            float variance = std::max(pixelVariance(sum.coeff(y, x), sumSquared.coeff(y, x), n).mean(), 0.0f);
+            result += func(variance, mean);
+        }
+    }
+    return (float) (result / ((double) size.x() * size.y()));
+}
+
+float ImageBlock::getRelativeError(const Point2i &offset, const Vector2i &size) const {
+    if (!hasMoments())
+        throw NoriException("ImageBlock::getRelativeError(): the block has no moments!");
+    return averageRelative(m_sum, m_sumSquared, m_sampleCounts, offset - m_offset, size,
+        [](float variance, float mean) { return std::sqrt(variance) / mean; });
+}
+
+float ImageBlock::getRelativeVariance(const Point2i &offset, const Vector2i &size) const {
+    if (!hasMoments())
+        throw NoriException("ImageBlock::getRelativeVariance(): the block has no moments!");
+    return averageRelative(m_sum, m_sumSquared, m_sampleCounts, offset - m_offset, size,
+        [](float variance, float mean) { return variance / (mean * mean); });
+}
+
+/// Raw binary I/O of a (dynamically sized) array, which must match in size when reading it back
+template <typename Array> static void writeArray(std::ostream &stream, const Array &array) {
+    int64_t size[2] = { array.rows(), array.cols() };
+    stream.write(reinterpret_cast<const char *>(size), sizeof(size));
+    stream.write(reinterpret_cast<const char *>(array.data()), sizeof(typename Array::Scalar) * array.size());
+}
+
+template <typename Array> static void readArray(std::istream &stream, Array &array) {
+    int64_t size[2];
+    stream.read(reinterpret_cast<char *>(size), sizeof(size));
+    if (!stream || size[0] != array.rows() || size[1] != array.cols())
+        throw NoriException("ImageBlock::loadState(): the stored block has a different size!");
+    stream.read(reinterpret_cast<char *>(array.data()), sizeof(typename Array::Scalar) * array.size());
+    if (!stream)
+        throw NoriException("ImageBlock::loadState(): unexpected end of the stream!");
+}
+
+void ImageBlock::saveState(std::ostream &stream) const {
+    writeArray(stream, static_cast<const Base &>(*this));
+    writeArray(stream, m_sum);
+    writeArray(stream, m_sumSquared);
+    writeArray(stream, m_sampleCounts);
+
+    /* The number of deferred samples varies */
+    uint64_t edgeSamples = m_edgeSamples.size();
+    stream.write(reinterpret_cast<const char *>(&edgeSamples), sizeof(edgeSamples));
+    stream.write(reinterpret_cast<const char *>(m_edgeSamples.data()), sizeof(Color4f) * edgeSamples);
+}
+
+void ImageBlock::loadState(std::istream &stream) {
+    readArray(stream, static_cast<Base &>(*this));
+    readArray(stream, m_sum);
+    readArray(stream, m_sumSquared);
+    readArray(stream, m_sampleCounts);
+
+    uint64_t edgeSamples;
+    stream.read(reinterpret_cast<char *>(&edgeSamples), sizeof(edgeSamples));
+    if (!stream)
+        throw NoriException("ImageBlock::loadState(): unexpected end of the stream!");
+    m_edgeSamples.resize((size_t) edgeSamples);
+    stream.read(reinterpret_cast<char *>(m_edgeSamples.data()), sizeof(Color4f) * edgeSamples);
+    if (!stream)
+        throw NoriException("ImageBlock::loadState(): unexpected end of the stream!");
+}
+
 void ImageBlock::fromBitmap(const Bitmap &bitmap) {
     if (bitmap.cols() != cols() || bitmap.rows() != rows())
         throw NoriException("Invalid bitmap dimensions!");
@@ -97,18 +212,17 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
         return;
     }
 
-    /* Convert to pixel coordinates within the image block */
-    Point2f pos(
-        _pos.x() - 0.5f - (m_offset.x() - m_borderSize),
-        _pos.y() - 0.5f - (m_offset.y() - m_borderSize)
-    );
+    /* Convert to pixel coordinates of the image. The filter weights are computed
+       in these coordinates, so that they don't depend on the offset of the block */
+    Point2f pos(_pos.x() - 0.5f, _pos.y() - 0.5f);
+    Point2i origin(m_offset.x() - m_borderSize, m_offset.y() - m_borderSize);
 
     /* Compute the rectangle of pixels that will need to be updated */
     BoundingBox2i bbox(
         Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
         Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
     );
-    bbox.clip(BoundingBox2i(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1)));
+    bbox.clip(BoundingBox2i(origin, origin + Vector2i((int) cols() - 1, (int) rows() - 1)));
 
     /* Lookup values from the pre-rasterized filter */
     for (int x=bbox.min.x(), idx = 0; x<=bbox.max.x(); ++x)
@@ -118,18 +232,179 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
 
     for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
         for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
-            coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+            coeffRef(y - origin.y(), x - origin.x()) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
 }
     
-void ImageBlock::put(ImageBlock &b) {
-    Vector2i offset = b.getOffset() - m_offset +
-        Vector2i::Constant(m_borderSize - b.getBorderSize());
-    Vector2i size   = b.getSize()   + Vector2i(2*b.getBorderSize());
+void ImageBlock::putInterior(const ImageBlock &b) {
+    Vector2i offset = b.getOffset() - m_offset + Vector2i::Constant(m_borderSize);
+    int borderSize = b.getBorderSize();
+
+    block(offset.y(), offset.x(), b.getSize().y(), b.getSize().x())
+        += b.block(borderSize, borderSize, b.getSize().y(), b.getSize().x());
+
+    /* Moments are only stored for the pixels of a block, which never overlap */
+    if (hasMoments() && b.hasMoments()) {
+        Vector2i momentsOffset = b.getOffset() - m_offset;
+        m_sum.block(momentsOffset.y(), momentsOffset.x(), b.getSize().y(), b.getSize().x())
+            += b.m_sum.topLeftCorner(b.getSize().y(), b.getSize().x());
+        m_sumSquared.block(momentsOffset.y(), momentsOffset.x(), b.getSize().y(), b.getSize().x())
+            += b.m_sumSquared.topLeftCorner(b.getSize().y(), b.getSize().x());
+        m_sampleCounts.block(momentsOffset.y(), momentsOffset.x(), b.getSize().y(), b.getSize().x())
+            += b.m_sampleCounts.topLeftCorner(b.getSize().y(), b.getSize().x());
+    }
+}
+
+/**
+ * Call \c func(y, x, height, width) for the four strips (rows above and below,
+ * columns to the left and right) that form the border of a block of the given
+ * size. The coordinates are relative to the top left corner of the border.
+ */
+template <typename Func> static void forEachBorderStrip(const Vector2i &size, int borderSize, const Func &func) {
+    int width = size.x() + 2*borderSize;
+    func(0, 0, borderSize, width);
+    func(borderSize + size.y(), 0, borderSize, width);
+    func(borderSize, 0, size.y(), borderSize);
+    func(borderSize, borderSize + size.x(), size.y(), borderSize);
+}
+
+/**
+ * Like \ref forEachBorderStrip(), but for the strips along the edges inside of
+ * the block whose pixels the borders of the neighbors reach into (the entire
+ * block if it is too small to have pixels that they don't reach)
+ */
+template <typename Func> static void forEachEdgeStrip(const Vector2i &size, int borderSize, const Func &func) {
+    if (size.x() <= 2*borderSize || size.y() <= 2*borderSize) {
+        func(borderSize, borderSize, size.y(), size.x());
+        return;
+    }
+    forEachBorderStrip(size - Vector2i::Constant(2*borderSize), borderSize, [&](int y, int x, int height, int width) {
+        func(y + borderSize, x + borderSize, height, width);
+    });
+}
+
+/// Number of pixels that a sample of a block stores in \ref BlockBorder::samples
+static size_t edgeSampleSize(const Vector2i &size, int borderSize) {
+    size_t count = 0;
+    auto add = [&](int, int, int height, int width) { count += (size_t) height * width; };
+    forEachBorderStrip(size, borderSize, add);
+    forEachEdgeStrip(size, borderSize, add);
+    return count;
+}
+
+void ImageBlock::putBorder(const ImageBlock &b) {
+    Vector2i offset = b.getOffset() - m_offset + Vector2i::Constant(m_borderSize - b.getBorderSize());
+
+    forEachBorderStrip(b.getSize(), b.getBorderSize(), [&](int y, int x, int height, int width) {
+        block(offset.y() + y, offset.x() + x, height, width) += b.block(y, x, height, width);
+    });
+}
+
+void ImageBlock::putBorder(const BlockBorder &b) {
+    Vector2i offset = b.offset - m_offset + Vector2i::Constant(m_borderSize - b.borderSize);
+    const Color4f *pixels = b.pixels.data();
+
+    forEachBorderStrip(b.size, b.borderSize, [&](int y, int x, int height, int width) {
+        block(offset.y() + y, offset.x() + x, height, width) += Eigen::Map<const Base>(pixels, height, width);
+        pixels += height * width;
+    });
+}
+
+void ImageBlock::getBorder(BlockBorder &border) const {
+    border.offset = m_offset;
+    border.size = m_size;
+    border.borderSize = m_borderSize;
+    border.pixels.resize((size_t) 2*m_borderSize * (m_size.x() + m_size.y() + 2*m_borderSize));
+    Color4f *pixels = border.pixels.data();
+
+    forEachBorderStrip(m_size, m_borderSize, [&](int y, int x, int height, int width) {
+        Eigen::Map<Base>(pixels, height, width) = block(y, x, height, width);
+        pixels += height * width;
+    });
+    border.samples.assign(m_edgeSamples.begin(), m_edgeSamples.end());
+}
+
+void ImageBlock::putEdgeMoments(const BlockBorder &b, const std::vector<const BlockBorder *> &neighbors) {
+    int borderSize = b.borderSize;
+    size_t sampleSize = edgeSampleSize(b.size, borderSize);
+    if (!hasMoments() || b.samples.empty() || borderSize == 0)
+        return;
 
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Values of a single sample in the pixels of the block (including its border) */
+    Base values = Base::Constant(b.size.y() + 2*borderSize, b.size.x() + 2*borderSize, Color4f());
+    Vector2i origin = b.offset - Vector2i::Constant(borderSize);
+
+    for (size_t i = 0; i < b.samples.size() / sampleSize; ++i) {
+        /* The sample of the block itself, after its border strips */
+        const Color4f *pixels = b.samples.data() + i * sampleSize
+            + (size_t) 2*borderSize * (b.size.x() + b.size.y() + 2*borderSize);
+        forEachEdgeStrip(b.size, borderSize, [&](int y, int x, int height, int width) {
+            values.block(y, x, height, width) = Eigen::Map<const Base>(pixels, height, width);
+            pixels += height * width;
+        });
+
+        /* Add the part of the border of every neighbor's sample with the same index that lies within the block */
+        for (const BlockBorder *neighbor : neighbors) {
+            size_t neighborSampleSize = edgeSampleSize(neighbor->size, neighbor->borderSize);
+            if ((i + 1) * neighborSampleSize > neighbor->samples.size())
+                continue;
+            const Color4f *pixels = neighbor->samples.data() + i * neighborSampleSize;
+            Vector2i shift = neighbor->offset - Vector2i::Constant(neighbor->borderSize) - origin;
+            forEachBorderStrip(neighbor->size, neighbor->borderSize, [&](int y, int x, int height, int width) {
+                int y0 = std::max(y + shift.y(), borderSize), y1 = std::min(y + shift.y() + height, borderSize + b.size.y());
+                int x0 = std::max(x + shift.x(), borderSize), x1 = std::min(x + shift.x() + width, borderSize + b.size.x());
+                if (y0 < y1 && x0 < x1)
+                    values.block(y0, x0, y1 - y0, x1 - x0) += Eigen::Map<const Base>(pixels, height, width)
+                        .block(y0 - y - shift.y(), x0 - x - shift.x(), y1 - y0, x1 - x0);
+                pixels += height * width;
+            });
+        }
 
-    block(offset.y(), offset.x(), size.y(), size.x()) 
-        += b.topLeftCorner(size.y(), size.x());
+        forEachEdgeStrip(b.size, borderSize, [&](int y, int x, int height, int width) {
+            Vector2i offset = origin - m_offset;
+            for (int yy = y; yy < y + height; ++yy) {
+                for (int xx = x; xx < x + width; ++xx) {
+                    Color3f value = values.coeff(yy, xx).divideByFilterWeight();
+                    m_sum.coeffRef(offset.y() + yy, offset.x() + xx) += value;
+                    m_sumSquared.coeffRef(offset.y() + yy, offset.x() + xx) += value * value;
+                    m_sampleCounts.coeffRef(offset.y() + yy, offset.x() + xx)++;
+                }
+            }
+        });
+    }
+}
+
+void ImageBlock::accumulate(const ImageBlock &b) {
+    Vector2i size = b.getSize() + Vector2i(2*b.getBorderSize());
+    topLeftCorner(size.y(), size.x()) += b.topLeftCorner(size.y(), size.x());
+
+    if (!hasMoments())
+        return;
+
+    /* The pixels near the edges also receive samples of the neighbors. Keep
+       this sample's values around them until the neighbors are known */
+    int borderSize = b.getBorderSize(), edge = 0;
+    if (m_deferEdgeMoments && borderSize > 0) {
+        edge = borderSize;
+        auto append = [&](int y, int x, int height, int width) {
+            for (int i = 0; i < height; ++i) {
+                const Color4f *row = b.data() + (size_t) (y + i) * b.cols() + x;
+                m_edgeSamples.insert(m_edgeSamples.end(), row, row + width);
+            }
+        };
+        forEachBorderStrip(b.getSize(), borderSize, append);
+        forEachEdgeStrip(b.getSize(), borderSize, append);
+    }
+
+    for (int y=0; y<b.getSize().y(); ++y) {
+        for (int x=0; x<b.getSize().x(); ++x) {
+            if (x < edge || y < edge || x >= b.getSize().x() - edge || y >= b.getSize().y() - edge)
+                continue;
+            Color3f value = b.coeff(y + borderSize, x + borderSize).divideByFilterWeight();
+            m_sum.coeffRef(y, x) += value;
+            m_sumSquared.coeffRef(y, x) += value * value;
+            m_sampleCounts.coeffRef(y, x)++;
+        }
+    }
 }
 
 std::string ImageBlock::toString() const {
@@ -137,54 +412,117 @@ std::string ImageBlock::toString() const {
         m_offset.toString(), m_size.toString());
 }
 
-BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
-        : m_size(size), m_blockSize(blockSize) {
+BlockGenerator::BlockGenerator(const Point2i &offset, const Vector2i &size, int blockSize)
+        : m_offset(offset), m_size(size), m_blockSize(blockSize), m_cursor(0) {
     m_numBlocks = Vector2i(
         (int) std::ceil(size.x() / (float) blockSize),
         (int) std::ceil(size.y() / (float) blockSize));
-    reset();
-}
-
-void BlockGenerator::reset() {
-    m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
-    m_direction = ERight;
-    m_block = Point2i(m_numBlocks / 2);
-    m_stepsLeft = 1;
-    m_numSteps = 1;
+    int blockCount = m_numBlocks.x() * m_numBlocks.y();
+    m_cost.resize(blockCount, 0.0f);
+
+    /* Walk through the blocks in a spiral starting at the center */
+    Point2i block(m_numBlocks / 2);
+    int direction = ERight, numSteps = 1, stepsLeft = 1;
+    m_spiral.reserve(blockCount);
+    while (true) {
+        m_spiral.push_back((uint32_t) (block.y() * m_numBlocks.x() + block.x()));
+        if ((int) m_spiral.size() == blockCount)
+            break;
+
+        do {
+            switch (direction) {
+                case ERight: ++block.x(); break;
+                case EDown:  ++block.y(); break;
+                case ELeft:  --block.x(); break;
+                case EUp:    --block.y(); break;
+            }
+
+            if (--stepsLeft == 0) {
+                direction = (direction + 1) % 4;
+                if (direction == ELeft || direction == ERight)
+                    ++numSteps;
+                stepsLeft = numSteps;
+            }
+        } while ((block.array() < 0).any() ||
+                 (block.array() >= m_numBlocks.array()).any());
+    }
 }
 
-bool BlockGenerator::next(ImageBlock &block) {
-    tbb::mutex::scoped_lock lock(m_mutex);
-
-    if (m_blocksLeft == 0)
-        return false;
-
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
+void BlockGenerator::getBlock(uint32_t blockId, ImageBlock &block) const {
+    Point2i pos = Point2i(blockId % m_numBlocks.x(), blockId / m_numBlocks.x()) * m_blockSize;
+    block.setOffset(m_offset + pos);
     block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
-    block.setBlockId(m_block.y() * m_numBlocks.x() + m_block.x());
+    block.setBlockId(blockId);
+}
 
-    if (--m_blocksLeft == 0)
-        return true;
+void BlockGenerator::getNeighbors(uint32_t blockId, std::vector<uint32_t> &neighbors) const {
+    Point2i pos(blockId % m_numBlocks.x(), blockId / m_numBlocks.x());
+    neighbors.clear();
+    for (int y = std::max(pos.y() - 1, 0); y <= std::min(pos.y() + 1, m_numBlocks.y() - 1); ++y)
+        for (int x = std::max(pos.x() - 1, 0); x <= std::min(pos.x() + 1, m_numBlocks.x() - 1); ++x)
+            if (x != pos.x() || y != pos.y())
+                neighbors.push_back((uint32_t) (y * m_numBlocks.x() + x));
+}
 
-    do {
-        switch (m_direction) {
-            case ERight: ++m_block.x(); break;
-            case EDown:  ++m_block.y(); break;
-            case ELeft:  --m_block.x(); break;
-            case EUp:    --m_block.y(); break;
+int BlockGenerator::beginPass(const std::vector<uint32_t> &samples, int threadCount) {
+    /* Blocks that haven't been measured yet are assumed to be average */
+    double measuredCost = 0;
+    int measuredCount = 0;
+    for (float cost : m_cost) {
+        if (cost > 0) {
+            measuredCost += cost;
+            measuredCount++;
         }
+    }
+    float defaultCost = measuredCount > 0 ? (float) (measuredCost / measuredCount) : 1.0f;
+
+    std::vector<float> passCost(m_cost.size());
+    double totalCost = 0;
+    m_order.clear();
+    for (uint32_t id : m_spiral) {
+        if (samples[id] == 0)
+            continue;
+        passCost[id] = (m_cost[id] > 0 ? m_cost[id] : defaultCost) * samples[id];
+        totalCost += passCost[id];
+        m_order.push_back(id);
+    }
 
-        if (--m_stepsLeft == 0) {
-            m_direction = (m_direction + 1) % 4;
-            if (m_direction == ELeft || m_direction == ERight) 
-                ++m_numSteps;
-            m_stepsLeft = m_numSteps;
+    /* Largest first, ties (e.g. in the first pass) stay in spiraling order */
+    std::stable_sort(m_order.begin(), m_order.end(),
+        [&](uint32_t a, uint32_t b) { return passCost[a] > passCost[b]; });
+
+    /* Bundle consecutive blocks until a task has a reasonably small fraction
+       of the work of a thread; expensive blocks always form a task on their own */
+    double taskCost = totalCost / (16.0 * std::max(threadCount, 1));
+    double cost = 0;
+    m_tasks.clear();
+    for (size_t i = 0; i < m_order.size(); ++i) {
+        float blockCost = passCost[m_order[i]];
+        if (m_tasks.empty() || cost + blockCost > taskCost) {
+            m_tasks.push_back((uint32_t) i);
+            cost = 0;
         }
-    } while ((m_block.array() < 0).any() ||
-             (m_block.array() >= m_numBlocks.array()).any());
+        cost += blockCost;
+    }
+    m_tasks.push_back((uint32_t) m_order.size());
+
+    m_cursor = 0;
+    return (int) m_tasks.size() - 1;
+}
 
+bool BlockGenerator::next(const uint32_t *&begin, const uint32_t *&end) {
+    size_t task = m_cursor++;
+    if (task + 1 >= m_tasks.size())
+        return false;
+
+    begin = m_order.data() + m_tasks[task];
+    end = m_order.data() + m_tasks[task + 1];
     return true;
 }
 
+void BlockGenerator::addCost(uint32_t blockId, uint32_t samples, double time) {
+    if (samples > 0)
+        m_cost[blockId] = (float) (time / samples);
+}
+
 NORI_NAMESPACE_END
@@ -0,0 +1,191 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/block.h>
+#include <nori/rfilter.h>
+#include <pcg32.h>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Test of the image and per-pixel moments of an image that is rendered in blocks
+ *
+ * Random samples are added to a single block that covers the entire image and
+ * to the blocks of a \ref BlockGenerator, which are merged in passes like in
+ * a rendering. Both must result in the same pixel values and variances. In
+ * particular, this checks the pixels near the edges of the blocks, which also
+ * receive samples of the neighboring blocks.
+ */
+class BlockTest : public NoriObject {
+public:
+    BlockTest(const PropertyList &propList) {
+        /* Size of the image; by default, the last row and column of blocks are cut off */
+        m_size = Vector2i(propList.getInteger("width", 58), propList.getInteger("height", 45));
+        m_blockSize = propList.getInteger("blockSize", 8);
+        m_passCount = propList.getInteger("passes", 2);
+        m_samplesPerPass = propList.getInteger("samplesPerPass", 8);
+
+        /* Maximum relative difference of a pixel value or variance */
+        m_tolerance = propList.getFloat("tolerance", 1e-3f);
+    }
+
+    virtual void addChild(NoriObject *obj) override {
+        switch (obj->getClassType()) {
+            case EReconstructionFilter:
+                m_filter.reset(static_cast<ReconstructionFilter *>(obj));
+                break;
+
+            default:
+                throw NoriException("BlockTest::addChild(<%s>) is not supported!",
+                    classTypeName(obj->getClassType()));
+        }
+    }
+
+    /// Render the same samples in one block and in many blocks and compare the results
+    virtual void activate() override {
+        if (!m_filter) {
+            m_filter.reset(static_cast<ReconstructionFilter *>(
+                NoriObjectFactory::createInstance("gaussian", PropertyList())));
+            m_filter->activate();
+        }
+
+        cout << "------------------------------------------------------" << endl;
+        cout << "Testing " << toString() << endl;
+
+        /* Reference: a single block */
+        ImageBlock reference(m_size, m_filter.get(), true);
+        ImageBlock sample(m_size, m_filter.get());
+        reference.clear();
+        for (int k = 0; k < m_passCount * m_samplesPerPass; ++k) {
+            sample.clear();
+            putSamples(sample, k);
+            reference.accumulate(sample);
+        }
+
+        /* The same samples in blocks */
+        ImageBlock image(m_size, m_filter.get(), true);
+        ImageBlock block(Vector2i(m_blockSize), m_filter.get());
+        ImageBlock accumBlock(Vector2i(m_blockSize), m_filter.get(), true);
+        accumBlock.setDeferEdgeMoments(true);
+        BlockGenerator generator(Point2i(0, 0), m_size, m_blockSize);
+        std::vector<BlockBorder> borders(generator.getBlockCount());
+        image.clear();
+
+        for (int pass = 0; pass < m_passCount; ++pass) {
+            for (int id = 0; id < generator.getBlockCount(); ++id) {
+                generator.getBlock((uint32_t) id, block);
+                accumBlock.setOffset(block.getOffset());
+                accumBlock.setSize(block.getSize());
+                accumBlock.clear();
+                for (int k = pass * m_samplesPerPass; k < (pass + 1) * m_samplesPerPass; ++k) {
+                    block.clear();
+                    putSamples(block, k);
+                    accumBlock.accumulate(block);
+                }
+                image.putInterior(accumBlock);
+                accumBlock.getBorder(borders[id]);
+            }
+
+            std::vector<uint32_t> neighborIds;
+            std::vector<const BlockBorder *> neighbors;
+            for (int id = 0; id < generator.getBlockCount(); ++id)
+                image.putBorder(borders[id]);
+            for (int id = 0; id < generator.getBlockCount(); ++id) {
+                generator.getNeighbors((uint32_t) id, neighborIds);
+                neighbors.clear();
+                for (uint32_t neighborId : neighborIds)
+                    neighbors.push_back(&borders[neighborId]);
+                image.putEdgeMoments(borders[id], neighbors);
+            }
+        }
+
+        int passed = 0;
+        std::unique_ptr<Bitmap> referenceBitmap(reference.toBitmap()), bitmap(image.toBitmap());
+        passed += compare("pixel values", *referenceBitmap, *bitmap) ? 1 : 0;
+        referenceBitmap.reset(reference.toVarianceBitmap());
+        bitmap.reset(image.toVarianceBitmap());
+        passed += compare("variances", *referenceBitmap, *bitmap) ? 1 : 0;
+        cout << "Passed " << passed << "/2 tests." << endl;
+    }
+
+    virtual std::string toString() const override {
+        return tfm::format(
+            "BlockTest[\n"
+            "  size = %s,\n"
+            "  blockSize = %i,\n"
+            "  passes = %i,\n"
+            "  samplesPerPass = %i,\n"
+            "  filter = %s\n"
+            "]",
+            m_size.toString(),
+            m_blockSize,
+            m_passCount,
+            m_samplesPerPass,
+            m_filter ? indent(m_filter->toString()) : std::string("null")
+        );
+    }
+
+    virtual EClassType getClassType() const override { return ETest; }
+private:
+    /// Add the sample \c k of every pixel of a block, which only depends on the pixel
+    void putSamples(ImageBlock &block, int k) const {
+        for (int y = block.getOffset().y(); y < block.getOffset().y() + block.getSize().y(); ++y) {
+            for (int x = block.getOffset().x(); x < block.getOffset().x() + block.getSize().x(); ++x) {
+                pcg32 random;
+                random.seed((uint64_t) y * m_size.x() + x, (uint64_t) k);
+                Point2f pos(x + random.nextFloat(), y + random.nextFloat());
+                block.put(pos, Color3f(random.nextFloat(), random.nextFloat(), random.nextFloat()));
+            }
+        }
+    }
+
+    /// Compare two bitmaps, separately for the pixels near the edges of the blocks and all others
+    bool compare(const std::string &name, const Bitmap &reference, const Bitmap &bitmap) const {
+        int borderSize = (int) std::ceil(m_filter->getRadius() - 0.5f);
+        float maxError[2] = { 0.f, 0.f };
+        for (int y = 0; y < m_size.y(); ++y) {
+            for (int x = 0; x < m_size.x(); ++x) {
+                int bx = x % m_blockSize, by = y % m_blockSize;
+                bool edge = bx < borderSize || by < borderSize ||
+                    bx >= m_blockSize - borderSize || by >= m_blockSize - borderSize;
+                for (int c = 0; c < 3; ++c) {
+                    float a = reference.coeff(y, x)[c], b = bitmap.coeff(y, x)[c];
+                    float error = std::abs(a - b) / std::max(std::max(std::abs(a), std::abs(b)), 1e-6f);
+                    maxError[edge ? 1 : 0] = std::max(maxError[edge ? 1 : 0], error);
+                }
+            }
+        }
+
+        bool result = std::max(maxError[0], maxError[1]) <= m_tolerance;
+        cout << tfm::format("Comparing %s: maximum relative error %g near the edges of the blocks, "
+                            "%g elsewhere .. %s", name, maxError[1], maxError[0],
+                            result ? "passed" : "FAILED") << endl;
+        return result;
+    }
+
+    std::unique_ptr<ReconstructionFilter> m_filter;
+    Vector2i m_size;
+    int m_blockSize;
+    int m_passCount;
+    int m_samplesPerPass;
+    float m_tolerance;
+};
+
+NORI_REGISTER_CLASS(BlockTest, "blocktest");
+NORI_NAMESPACE_END
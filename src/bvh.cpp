@@ -17,11 +17,19 @@
 */
 
 #include <nori/bvh.h>
+#include <nori/mesh.h>
 #include <nori/timer.h>
+#include <nori/cache.h>
+#include <nori/stats.h>
+#include <nori/profiler.h>
 #include <tbb/tbb.h>
 #include <Eigen/Geometry>
 #include <atomic>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
  * =======================================================================
  *   WARNING    WARNING    WARNING    WARNING    WARNING    WARNING
@@ -309,27 +317,229 @@ void BVH::addShape(Shape *shape) {
     m_shapes.push_back(shape);
     m_shapeOffset.push_back(m_shapeOffset.back() + shape->getPrimitiveCount());
     m_bbox.expandBy(shape->getBoundingBox());
+    NORI_STATS_ONLY(m_shapeTypes.push_back(Statistics::getShapeType(typeid(*shape))));
 }
 
 void BVH::clear() {
     for (auto shape : m_shapes)
         delete shape;
     m_shapes.clear();
+    NORI_STATS_ONLY(m_shapeTypes.clear());
     m_shapeOffset.clear();
     m_shapeOffset.push_back(0u);
     m_nodes.clear();
+    m_wideNodes.clear();
     m_indices.clear();
+    m_primitives.clear();
+    m_triangles.clear();
+    m_triangleStorageSize = 0;
     m_bbox.reset();
     m_nodes.shrink_to_fit();
+    m_wideNodes.shrink_to_fit();
     m_shapes.shrink_to_fit();
     m_shapeOffset.shrink_to_fit();
     m_indices.shrink_to_fit();
+    m_primitives.shrink_to_fit();
+    m_triangles.shrink_to_fit();
+}
+
+void BVH::rebuild() {
+    m_bbox.reset();
+    for (auto shape : m_shapes)
+        m_bbox.expandBy(shape->getBoundingBox());
+    m_nodes.clear();
+    m_wideNodes.clear();
+    build(false);
 }
 
-void BVH::build() {
-    uint32_t size  = getPrimitiveCount();
+void BVH::build(bool useCache) {
+    uint32_t size = getPrimitiveCount();
     if (size == 0)
         return;
+    ProfileZone zone("BVH::build");
+
+    /* Look up the shape of every primitive once instead of searching the shape offsets */
+    m_primitives.resize(size);
+    for (uint32_t shapeIdx = 0; shapeIdx < (uint32_t) m_shapes.size(); ++shapeIdx)
+        for (uint32_t i = m_shapeOffset[shapeIdx]; i < m_shapeOffset[shapeIdx + 1]; ++i)
+            m_primitives[i] = PrimitiveRef { shapeIdx, i - m_shapeOffset[shapeIdx] };
+
+    /* The tree only depends on the bounding boxes and centroids of the
+       primitives, so it can be reused for any scene with the same ones */
+    struct Tree {
+        std::vector<BVHNode> nodes;
+        std::vector<PrimitiveRef> primitives;
+    };
+    bool built = false;
+    auto buildNewTree = [&] {
+        built = true;
+        buildTree();
+        /* The sorted primitives stay with this BVH, only a cached tree keeps its own copy */
+        Tree *result = new Tree { std::move(m_nodes), {} };
+        if (useCache && getAssetCache()->isEnabled())
+            result->primitives = m_primitives;
+        return std::shared_ptr<Tree>(result);
+    };
+    std::shared_ptr<Tree> tree = !useCache ? buildNewTree() : getAssetCache()->get<Tree>("BVH",
+        [&] {
+            uint64_t hash = AssetCache::hash(m_shapeOffset.data(), sizeof(uint32_t) * m_shapeOffset.size());
+            for (uint32_t i = 0; i < size; ++i) {
+                BoundingBox3f bbox = getBoundingBox(i);
+                Point3f centroid = getCentroid(i);
+                hash = AssetCache::hash(bbox.min.data(), sizeof(float) * 3, hash);
+                hash = AssetCache::hash(bbox.max.data(), sizeof(float) * 3, hash);
+                hash = AssetCache::hash(centroid.data(), sizeof(float) * 3, hash);
+            }
+            return hash;
+        }, buildNewTree);
+
+    if (!built) {
+        cout << "Reusing a SAH BVH (" << m_shapes.size()
+             << (m_shapes.size() == 1 ? " shape, " : " shapes, ")
+             << size << " primitives) from the cache." << endl;
+        m_primitives = tree->primitives;
+    }
+
+    /* Traversal uses a 4-wide version of the (cached) binary tree */
+    m_wideNodes.clear();
+    m_wideNodes.reserve(tree->nodes.size() / 3 + 1);
+    collapse(tree->nodes, 0);
+
+    precomputeTriangles();
+}
+
+uint32_t BVH::collapse(const std::vector<BVHNode> &nodes, uint32_t index) {
+    /* Pull the grandchildren of the largest inner children into this node */
+    uint32_t children[4] = { index, 0, 0, 0 };
+    int childCount = 1;
+    if (nodes[index].isInner()) {
+        children[0] = index + 1;
+        children[1] = nodes[index].inner.rightChild;
+        childCount = 2;
+    }
+    while (childCount < 4) {
+        int best = -1;
+        float bestArea = -1;
+        for (int i = 0; i < childCount; ++i) {
+            const BVHNode &child = nodes[children[i]];
+            if (child.isInner() && child.bbox.getSurfaceArea() > bestArea) {
+                best = i;
+                bestArea = child.bbox.getSurfaceArea();
+            }
+        }
+        if (best < 0)
+            break;
+        uint32_t expanded = children[best];
+        children[best] = expanded + 1;
+        children[childCount++] = nodes[expanded].inner.rightChild;
+    }
+
+    uint32_t wideIndex = (uint32_t) m_wideNodes.size();
+    m_wideNodes.emplace_back();
+
+    WideNode node;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            node.bounds[j][i] = std::numeric_limits<float>::infinity();
+            node.bounds[j + 3][i] = -std::numeric_limits<float>::infinity();
+        }
+        node.child[i] = node.count[i] = 0;
+    }
+
+    for (int i = 0; i < childCount; ++i) {
+        const BVHNode &child = nodes[children[i]];
+        for (int j = 0; j < 3; ++j) {
+            node.bounds[j][i] = child.bbox.min[j];
+            node.bounds[j + 3][i] = child.bbox.max[j];
+        }
+        if (child.isLeaf()) {
+            node.child[i] = child.start();
+            node.count[i] = child.leaf.size;
+        } else {
+            node.child[i] = collapse(nodes, children[i]);
+        }
+    }
+
+    m_wideNodes[wideIndex] = node;
+    return wideIndex;
+}
+
+void BVH::precomputeTriangles() {
+    m_triangles.clear();
+    m_triangleStorageSize = 0;
+    if (!m_precomputeTriangles)
+        return;
+
+    std::vector<const Mesh *> meshes(m_shapes.size());
+    for (size_t i = 0; i < m_shapes.size(); ++i)
+        meshes[i] = dynamic_cast<const Mesh *>(m_shapes[i]);
+
+    /* Entries that only align the leaves are never visited */
+    std::vector<PrimitiveRef> primitives;
+    primitives.reserve(m_primitives.size() + m_primitives.size() / 2);
+    auto align = [&]() {
+        while (primitives.size() % 4 != 0)
+            primitives.push_back(PrimitiveRef { 0, 0 });
+    };
+
+    uint32_t triangleCount = 0;
+    for (WideNode &node : m_wideNodes) {
+        for (int k = 0; k < 4; ++k) {
+            if (node.count[k] == 0)
+                continue;
+            uint32_t start = node.child[k], end = start + node.count[k];
+
+            /* Mesh triangles first, in their original order */
+            align();
+            uint32_t leafStart = (uint32_t) primitives.size();
+            for (uint32_t i = start; i < end; ++i)
+                if (meshes[m_primitives[i].shape])
+                    primitives.push_back(m_primitives[i]);
+            uint32_t leafTriangles = (uint32_t) primitives.size() - leafStart;
+            align();
+
+            m_triangles.resize(primitives.size() / 4);
+            for (uint32_t i = 0; i < leafTriangles; ++i) {
+                const PrimitiveRef &prim = primitives[leafStart + i];
+                const Mesh *mesh = meshes[prim.shape];
+                const Eigen::Map<const MatrixXu> &F = mesh->getIndices();
+                const Eigen::Map<const MatrixXf> &V = mesh->getVertexPositions();
+                const Point3f p0 = V.col(F(0, prim.index)), p1 = V.col(F(1, prim.index)),
+                              p2 = V.col(F(2, prim.index));
+                Vector3f edge1 = p1 - p0, edge2 = p2 - p0;
+
+                TriangleBlock &block = m_triangles[(leafStart + i) / 4];
+                uint32_t lane = (leafStart + i) % 4;
+                for (int j = 0; j < 3; ++j) {
+                    block.p0[j][lane] = p0[j];
+                    block.edge1[j][lane] = edge1[j];
+                    block.edge2[j][lane] = edge2[j];
+                }
+                block.count = lane + 1;
+            }
+            triangleCount += leafTriangles;
+
+            /* Followed by all other primitives */
+            for (uint32_t i = start; i < end; ++i)
+                if (!meshes[m_primitives[i].shape])
+                    primitives.push_back(m_primitives[i]);
+
+            node.child[k] = leafStart;
+            node.count[k] = (uint32_t) primitives.size() - leafStart;
+        }
+    }
+    m_triangles.resize((primitives.size() + 3) / 4);
+
+    m_triangleStorageSize = sizeof(TriangleBlock) * m_triangles.size()
+        + sizeof(PrimitiveRef) * (primitives.size() - m_primitives.size());
+    m_primitives = std::move(primitives);
+
+    cout << "Precomputed " << triangleCount << " triangles for the BVH ("
+         << memString(m_triangleStorageSize) << ")." << endl;
+}
+
+void BVH::buildTree() {
+    uint32_t size = getPrimitiveCount();
     cout << "Constructing a SAH BVH (" << m_shapes.size()
         << (m_shapes.size() == 1 ? " shape, " : " shapes, ")
         << size << " primitives) .. ";
@@ -353,6 +563,15 @@ void BVH::build() {
         BVHBuildTask(*this, 0u, indices, indices + size , temp);
     tbb::task::spawn_root_and_wait(task);
     delete[] temp;
+
+    /* Store the references of the primitives in the order of the leaves */
+    std::vector<PrimitiveRef> primitives(size);
+    for (uint32_t i = 0; i < size; ++i)
+        primitives[i] = m_primitives[m_indices[i]];
+    m_primitives = std::move(primitives);
+    m_indices.clear();
+    m_indices.shrink_to_fit();
+
     std::pair<float, uint32_t> stats = statistics();
 
     /* The node array was allocated conservatively and now contains
@@ -374,7 +593,7 @@ void BVH::build() {
         }
     }
     cout << "done (took " << timer.elapsedString() << " and "
-        << memString(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t)*m_indices.size())
+        << memString(sizeof(BVHNode) * m_nodes.size() + sizeof(PrimitiveRef)*m_primitives.size())
         << ", SAH cost = " << stats.first
         << ")." << endl;
 
@@ -401,9 +620,312 @@ std::pair<float, uint32_t> BVH::statistics(uint32_t node_idx) const {
     }
 }
 
-bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
-    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+/// Ray data for \ref intersectChildren(), prepared once per ray
+struct WideRay {
+    float o[3], dRcp[3];
+    int nearIdx[3], farIdx[3];
+
+    WideRay(const Ray3f &ray) {
+        for (int i = 0; i < 3; ++i) {
+            o[i] = ray.o[i];
+            dRcp[i] = ray.dRcp[i];
+            bool negative = std::signbit(ray.dRcp[i]);
+            nearIdx[i] = negative ? i + 3 : i;
+            farIdx[i] = negative ? i : i + 3;
+        }
+    }
+};
+
+/**
+ * Intersect a ray with the four children of a wide node and return a bit
+ * mask of the children that it enters within [ray.mint, ray.maxt], along
+ * with the distances at which it enters them.
+ *
+ * The slabs are computed from the bounds on the near and far side of the
+ * origin (selected by the sign of the direction), which avoids any swaps.
+ * A zero direction component yields infinite distances, or NaN if the
+ * origin lies exactly on a slab plane; the min/max operations return their
+ * second operand for NaNs, which then ignores that slab like the scalar
+ * \ref BoundingBox3f::rayIntersect().
+ */
+#if defined(__SSE2__)
+static inline int intersectChildren(const float (&bounds)[6][4], const WideRay &wray,
+                                    float mint, float maxt, float *nearT) {
+    __m128 tNear = _mm_set1_ps(mint), tFar = _mm_set1_ps(maxt);
+    for (int i = 0; i < 3; ++i) {
+        __m128 o = _mm_set1_ps(wray.o[i]), dRcp = _mm_set1_ps(wray.dRcp[i]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds[wray.nearIdx[i]]), o), dRcp);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds[wray.farIdx[i]]), o), dRcp);
+        tNear = _mm_max_ps(t0, tNear);
+        tFar = _mm_min_ps(t1, tFar);
+    }
+    _mm_storeu_ps(nearT, tNear);
+    return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+#else
+static inline int intersectChildren(const float (&bounds)[6][4], const WideRay &wray,
+                                    float mint, float maxt, float *nearT) {
+    int mask = 0;
+    for (int k = 0; k < 4; ++k) {
+        float tNear = mint, tFar = maxt;
+        for (int i = 0; i < 3; ++i) {
+            float t0 = (bounds[wray.nearIdx[i]][k] - wray.o[i]) * wray.dRcp[i];
+            float t1 = (bounds[wray.farIdx[i]][k] - wray.o[i]) * wray.dRcp[i];
+            tNear = t0 > tNear ? t0 : tNear;
+            tFar = t1 < tFar ? t1 : tFar;
+        }
+        nearT[k] = tNear;
+        mask |= (tNear <= tFar ? 1 : 0) << k;
+    }
+    return mask;
+}
+#endif
+
+/// The rays of a packet in SoA layout, with the adaptive epsilon applied
+struct PacketRays {
+    alignas(16) float o[3][BVH::PacketSize];
+    alignas(16) float dRcp[3][BVH::PacketSize];
+    alignas(16) float mint[BVH::PacketSize];
+    alignas(16) float maxt[BVH::PacketSize];
+};
+
+#if defined(__SSE2__)
+/// Expand a 4-bit mask into a mask of SSE lanes
+static inline __m128 laneMask(uint32_t mask) {
+    alignas(16) static const int32_t masks[16][4] = {
+        {  0,  0,  0,  0 }, { -1,  0,  0,  0 }, {  0, -1,  0,  0 }, { -1, -1,  0,  0 },
+        {  0,  0, -1,  0 }, { -1,  0, -1,  0 }, {  0, -1, -1,  0 }, { -1, -1, -1,  0 },
+        {  0,  0,  0, -1 }, { -1,  0,  0, -1 }, {  0, -1,  0, -1 }, { -1, -1,  0, -1 },
+        {  0,  0, -1, -1 }, { -1,  0, -1, -1 }, {  0, -1, -1, -1 }, { -1, -1, -1, -1 }
+    };
+    return _mm_load_ps(reinterpret_cast<const float *>(masks[mask]));
+}
+#endif
+
+/**
+ * Intersect the rays \c mask of a packet with child \c k of a wide node
+ * and return the mask of those that enter it within [mint, maxt], along with
+ * the distances at which they enter it (per ray) and the nearest of them.
+ *
+ * Every ray goes through the same operations as in \ref intersectChildren(),
+ * so that both agree. The SSE version tests four rays at once and selects
+ * the near and far bounds by the sign bits of their directions.
+ */
+#if defined(__SSE2__)
+static inline uint32_t intersectChildPacket(const float (&bounds)[6][4], int k,
+        const PacketRays &rays, uint32_t mask, float *nearT, float &minNearT) {
+    __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 minT = inf;
+    uint32_t result = 0;
+    for (uint32_t g = 0; g < BVH::PacketSize / 4; ++g) {
+        uint32_t groupMask = (mask >> (4 * g)) & 0xF;
+        if (groupMask == 0)
+            continue;
+        __m128 tNear = _mm_load_ps(rays.mint + 4 * g), tFar = _mm_load_ps(rays.maxt + 4 * g);
+        for (int i = 0; i < 3; ++i) {
+            __m128 o = _mm_load_ps(rays.o[i] + 4 * g), dRcp = _mm_load_ps(rays.dRcp[i] + 4 * g);
+            __m128 negative = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(dRcp), 31));
+            __m128 lower = _mm_set1_ps(bounds[i][k]), upper = _mm_set1_ps(bounds[i + 3][k]);
+            __m128 nearBound = _mm_or_ps(_mm_and_ps(negative, upper), _mm_andnot_ps(negative, lower));
+            __m128 farBound = _mm_or_ps(_mm_and_ps(negative, lower), _mm_andnot_ps(negative, upper));
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(nearBound, o), dRcp);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(farBound, o), dRcp);
+            tNear = _mm_max_ps(t0, tNear);
+            tFar = _mm_min_ps(t1, tFar);
+        }
+        __m128 hitLanes = _mm_and_ps(_mm_cmple_ps(tNear, tFar), laneMask(groupMask));
+        uint32_t hit = (uint32_t) _mm_movemask_ps(hitLanes);
+        if (hit == 0)
+            continue;
+        minT = _mm_min_ps(minT, _mm_or_ps(_mm_and_ps(hitLanes, tNear), _mm_andnot_ps(hitLanes, inf)));
+        _mm_store_ps(nearT + 4 * g, tNear);
+        result |= hit << (4 * g);
+    }
+    minT = _mm_min_ps(minT, _mm_shuffle_ps(minT, minT, _MM_SHUFFLE(2, 3, 0, 1)));
+    minT = _mm_min_ps(minT, _mm_shuffle_ps(minT, minT, _MM_SHUFFLE(1, 0, 3, 2)));
+    minNearT = _mm_cvtss_f32(minT);
+    return result;
+}
+
+/// Return those rays of \c mask that enter a child before their closest intersection
+static inline uint32_t activeRays(const float *nearT, const PacketRays &rays, uint32_t mask) {
+    uint32_t result = 0;
+    for (uint32_t g = 0; g < BVH::PacketSize / 4; ++g) {
+        if (((mask >> (4 * g)) & 0xF) == 0)
+            continue;
+        __m128 le = _mm_cmple_ps(_mm_load_ps(nearT + 4 * g), _mm_load_ps(rays.maxt + 4 * g));
+        result |= (uint32_t) _mm_movemask_ps(le) << (4 * g);
+    }
+    return result & mask;
+}
+#else
+static inline uint32_t intersectChildPacket(const float (&bounds)[6][4], int k,
+        const PacketRays &rays, uint32_t mask, float *nearT, float &minNearT) {
+    uint32_t result = 0;
+    minNearT = std::numeric_limits<float>::infinity();
+    for (uint32_t r = 0; r < BVH::PacketSize; ++r) {
+        if (!(mask & (1u << r)))
+            continue;
+        float tNear = rays.mint[r], tFar = rays.maxt[r];
+        for (int i = 0; i < 3; ++i) {
+            bool negative = std::signbit(rays.dRcp[i][r]);
+            float t0 = (bounds[negative ? i + 3 : i][k] - rays.o[i][r]) * rays.dRcp[i][r];
+            float t1 = (bounds[negative ? i : i + 3][k] - rays.o[i][r]) * rays.dRcp[i][r];
+            tNear = t0 > tNear ? t0 : tNear;
+            tFar = t1 < tFar ? t1 : tFar;
+        }
+        if (tNear <= tFar) {
+            result |= 1u << r;
+            nearT[r] = tNear;
+            minNearT = std::min(minNearT, tNear);
+        }
+    }
+    return result;
+}
+
+static inline uint32_t activeRays(const float *nearT, const PacketRays &rays, uint32_t mask) {
+    uint32_t result = 0;
+    for (uint32_t r = 0; r < BVH::PacketSize; ++r)
+        if ((mask & (1u << r)) && nearT[r] <= rays.maxt[r])
+            result |= 1u << r;
+    return result;
+}
+#endif
+
+/**
+ * Intersect a ray with four triangles in SoA layout (see \ref BVH::TriangleBlock)
+ * and return a bit mask of those that it hits within [ray.mint, ray.maxt].
+ *
+ * This is the algorithm of \ref Mesh::rayIntersect() with exactly the same
+ * sequence of floating point operations, so that both find the same hits.
+ * Note that Eigen sums the dot product of 3D vectors as x + (y + z).
+ */
+#if defined(__SSE2__)
+static inline int intersectTriangles(const float (&p0)[3][4], const float (&edge1)[3][4],
+                                     const float (&edge2)[3][4], const Ray3f &ray,
+                                     float *u, float *v, float *t) {
+    __m128 e1x = _mm_loadu_ps(edge1[0]), e1y = _mm_loadu_ps(edge1[1]), e1z = _mm_loadu_ps(edge1[2]);
+    __m128 e2x = _mm_loadu_ps(edge2[0]), e2y = _mm_loadu_ps(edge2[1]), e2z = _mm_loadu_ps(edge2[2]);
+    __m128 dx = _mm_set1_ps(ray.d.x()), dy = _mm_set1_ps(ray.d.y()), dz = _mm_set1_ps(ray.d.z());
+
+    /* pvec = d x edge2, det = edge1 . pvec */
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_mul_ps(e1x, px), _mm_add_ps(_mm_mul_ps(e1y, py), _mm_mul_ps(e1z, pz)));
+    __m128 reject = _mm_and_ps(_mm_cmpgt_ps(det, _mm_set1_ps(-1e-8f)), _mm_cmplt_ps(det, _mm_set1_ps(1e-8f)));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    /* tvec = o - p0, u = (tvec . pvec) / det */
+    __m128 tx = _mm_sub_ps(_mm_set1_ps(ray.o.x()), _mm_loadu_ps(p0[0]));
+    __m128 ty = _mm_sub_ps(_mm_set1_ps(ray.o.y()), _mm_loadu_ps(p0[1]));
+    __m128 tz = _mm_sub_ps(_mm_set1_ps(ray.o.z()), _mm_loadu_ps(p0[2]));
+    __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_add_ps(_mm_mul_ps(ty, py), _mm_mul_ps(tz, pz))), invDet);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(uu, zero), _mm_cmpgt_ps(uu, one)));
+
+    /* qvec = tvec x edge1, v = (d . qvec) / det */
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_add_ps(_mm_mul_ps(dy, qy), _mm_mul_ps(dz, qz))), invDet);
+    reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(vv, zero), _mm_cmpgt_ps(_mm_add_ps(uu, vv), one)));
+
+    /* t = (edge2 . qvec) / det */
+    __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_add_ps(_mm_mul_ps(e2y, qy), _mm_mul_ps(e2z, qz))), invDet);
+    __m128 accept = _mm_andnot_ps(reject, _mm_and_ps(_mm_cmpge_ps(tt, _mm_set1_ps(ray.mint)),
+                                                     _mm_cmple_ps(tt, _mm_set1_ps(ray.maxt))));
+
+    _mm_storeu_ps(u, uu);
+    _mm_storeu_ps(v, vv);
+    _mm_storeu_ps(t, tt);
+    return _mm_movemask_ps(accept);
+}
+#else
+static inline int intersectTriangles(const float (&p0)[3][4], const float (&edge1)[3][4],
+                                     const float (&edge2)[3][4], const Ray3f &ray,
+                                     float *u, float *v, float *t) {
+    int mask = 0;
+    for (int k = 0; k < 4; ++k) {
+        Vector3f e1(edge1[0][k], edge1[1][k], edge1[2][k]), e2(edge2[0][k], edge2[1][k], edge2[2][k]);
+        Vector3f pvec = ray.d.cross(e2);
+        float det = e1.dot(pvec);
+        if (det > -1e-8f && det < 1e-8f)
+            continue;
+        float inv_det = 1.0f / det;
+        Vector3f tvec = ray.o - Point3f(p0[0][k], p0[1][k], p0[2][k]);
+        u[k] = tvec.dot(pvec) * inv_det;
+        if (u[k] < 0.0 || u[k] > 1.0)
+            continue;
+        Vector3f qvec = tvec.cross(e1);
+        v[k] = ray.d.dot(qvec) * inv_det;
+        if (v[k] < 0.0 || u[k] + v[k] > 1.0)
+            continue;
+        t[k] = e2.dot(qvec) * inv_det;
+        if (t[k] >= ray.mint && t[k] <= ray.maxt)
+            mask |= 1 << k;
+    }
+    return mask;
+}
+#endif
+
+bool BVH::intersectLeaf(uint32_t start, uint32_t end, Ray3f &ray, Intersection &its,
+        uint32_t &f, bool shadowRay, uint64_t &primitiveTests) const {
+    bool foundIntersection = false;
+    uint32_t i = start;
+
+    /* Precomputed triangles, four at a time */
+    for (; i < end && !m_triangles.empty() && m_triangles[i / 4].count > 0; i += 4) {
+        const TriangleBlock &block = m_triangles[i / 4];
+        NORI_STATS_ONLY(primitiveTests += block.count);
+#if defined(NORI_STATS)
+        for (uint32_t k = 0; k < block.count; ++k)
+            NORI_STATS_SHAPE_TEST(m_shapeTypes[m_primitives[i + k].shape]);
+#endif
+
+        float u[4], v[4], t[4];
+        int mask = intersectTriangles(block.p0, block.edge1, block.edge2, ray, u, v, t);
+        if (mask == 0)
+            continue;
+        if (shadowRay)
+            return true;
+
+        /* On ties, the later triangle wins like in the sequential loop */
+        int lane = -1;
+        for (int k = 0; k < 4; ++k)
+            if ((mask & (1 << k)) && (lane < 0 || t[k] <= t[lane]))
+                lane = k;
+
+        const PrimitiveRef &prim = m_primitives[i + lane];
+        foundIntersection = true;
+        ray.maxt = its.t = t[lane];
+        its.uv = Point2f(u[lane], v[lane]);
+        its.mesh = m_shapes[prim.shape];
+        f = prim.index;
+    }
+
+    for (; i < end; ++i) {
+        const PrimitiveRef &prim = m_primitives[i];
+        const Shape *shape = m_shapes[prim.shape];
+        NORI_STATS_ONLY(primitiveTests++);
+        NORI_STATS_SHAPE_TEST(m_shapeTypes[prim.shape]);
+
+        float u, v, t;
+        if (shape->rayIntersect(prim.index, ray, u, v, t)) {
+            if (shadowRay)
+                return true;
+            foundIntersection = true;
+            ray.maxt = its.t = t;
+            its.uv = Point2f(u, v);
+            its.mesh = shape;
+            f = prim.index;
+        }
+    }
+
+    return foundIntersection;
+}
 
+bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
     its.t = std::numeric_limits<float>::infinity();
 
     /* Use an adaptive ray epsilon */
@@ -411,54 +933,276 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
     if (ray.mint == Epsilon)
         ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
 
-    if (m_nodes.empty() || ray.maxt < ray.mint)
+    if (shadowRay)
+        NORI_STATS_ADD(EShadowRays, 1);
+    else
+        NORI_STATS_ADD(EIntersectionRays, 1);
+
+    float rootNearT;
+    if (m_wideNodes.empty() || ray.maxt < ray.mint || !m_bbox.rayIntersect(ray, rootNearT))
         return false;
 
-    bool foundIntersection = false;
+    /* Traversal steps are counted locally and added once per ray. Every
+       wide node counts as one visit */
+    uint64_t nodeVisits = 0, primitiveTests = 0;
     uint32_t f = 0;
+    bool foundIntersection = traverse(0, 0, ray, its, f, shadowRay, nodeVisits, primitiveTests);
+
+    NORI_STATS_ADD(EBVHNodeVisits, nodeVisits);
+    NORI_STATS_ADD(EPrimitiveTests, primitiveTests);
+
+    if (foundIntersection && !shadowRay) {
+        its.mesh->setHitInformation(f,ray,its);
+    }
+
+    return foundIntersection;
+}
+
+bool BVH::traverse(uint32_t child, uint32_t count, Ray3f &ray, Intersection &its, uint32_t &f,
+        bool shadowRay, uint64_t &nodeVisits, uint64_t &primitiveTests) const {
+    /* Children that remain to be visited (wide nodes or leaves, see \ref WideNode)
+       along with the distance at which the ray enters them */
+    struct StackEntry {
+        uint32_t child, count;
+        float nearT;
+    };
+    StackEntry stack[3 * 64];
+    uint32_t stack_idx = 0;
+
+    bool foundIntersection = false;
+    WideRay wray(ray);
+
+    StackEntry current { child, count, 0.f };
+    bool hit = true;
+
+    while (hit) {
+        if (current.count == 0) {
+            const WideNode &node = m_wideNodes[current.child];
+            NORI_STATS_ONLY(nodeVisits++);
+
+            float nearT[4];
+            int mask = intersectChildren(node.bounds, wray, ray.mint, ray.maxt, nearT);
+
+            /* Visit the children front to back: sort the hit ones by their entry
+               distance (skipped for shadow rays, which stop at any hit) and push
+               all but the nearest in reverse order */
+            StackEntry hits[4];
+            int hitCount = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (!(mask & (1 << i)))
+                    continue;
+                StackEntry entry { node.child[i], node.count[i], nearT[i] };
+                int j = hitCount++;
+                if (!shadowRay) {
+                    for (; j > 0 && hits[j - 1].nearT > entry.nearT; --j)
+                        hits[j] = hits[j - 1];
+                }
+                hits[j] = entry;
+            }
 
-    while (true) {
-        const BVHNode &node = m_nodes[node_idx];
+            if (hitCount > 0) {
+                for (int i = hitCount - 1; i > 0; --i)
+                    stack[stack_idx++] = hits[i];
+                assert(stack_idx <= 3 * 64);
+                current = hits[0];
+                continue;
+            }
+        } else if (intersectLeaf(current.child, current.child + current.count,
+                                 ray, its, f, shadowRay, primitiveTests)) {
+            foundIntersection = true;
+            if (shadowRay)
+                break;
+        }
 
-        if (!node.bbox.rayIntersect(ray)) {
-            if (stack_idx == 0)
+        /* Continue with the most recently pushed child, skipping those that the
+           ray only enters beyond the closest intersection found so far */
+        hit = false;
+        while (stack_idx > 0) {
+            const StackEntry &entry = stack[--stack_idx];
+            if (entry.nearT <= ray.maxt) {
+                current = entry;
+                hit = true;
                 break;
-            node_idx = stack[--stack_idx];
+            }
+        }
+    }
+
+    return foundIntersection;
+}
+
+void BVH::rayIntersect(const Ray3f *rays, uint32_t count, Intersection *its,
+        bool *hits, bool shadowRay) const {
+    Intersection unused; /* Receives nothing for shadow rays */
+    for (uint32_t i = 0; i < count; i += PacketSize) {
+        uint32_t packetSize = std::min(count - i, PacketSize);
+        /* A single ray is traced faster on its own */
+        if (packetSize == 1)
+            hits[i] = rayIntersect(rays[i], its ? its[i] : unused, shadowRay);
+        else
+            rayIntersectPacket(rays + i, packetSize, its ? its + i : nullptr, hits + i, shadowRay);
+    }
+}
+
+void BVH::rayIntersectPacket(const Ray3f *_rays, uint32_t count, Intersection *its,
+        bool *hits, bool shadowRay) const {
+    /* Like in the single-ray traversal, but every entry also records which
+       rays of the packet enter the child (bit r of the mask refers to ray r),
+       and the distance at which each of them enters it is kept alongside */
+    struct StackEntry {
+        uint32_t child, count;
+        uint32_t mask;
+        float nearT; /* Nearest over all rays, used to order the children */
+    };
+    StackEntry stack[3 * 64];
+    alignas(16) float stackNearT[3 * 64][PacketSize];
+    uint32_t stack_idx = 0;
+
+    Ray3f rays[PacketSize];
+    PacketRays packet;
+    uint32_t f[PacketSize];
+    Intersection unused; /* Receives nothing for shadow rays */
+    uint32_t active = 0, found = 0;
+    float rootNearT = std::numeric_limits<float>::infinity();
+
+    assert(count <= PacketSize);
+    if (shadowRay)
+        NORI_STATS_ADD(EShadowRays, count);
+    else
+        NORI_STATS_ADD(EIntersectionRays, count);
+
+    for (uint32_t r = 0; r < PacketSize; ++r) {
+        if (r >= count) {
+            /* Padding, which never enters a node */
+            for (int i = 0; i < 3; ++i)
+                packet.o[i][r] = packet.dRcp[i][r] = 0.f;
+            packet.mint[r] = std::numeric_limits<float>::infinity();
+            packet.maxt[r] = 0.f;
             continue;
         }
 
-        if (node.isInner()) {
-            stack[stack_idx++] = node.inner.rightChild;
-            node_idx++;
-            assert(stack_idx<64);
+        hits[r] = false;
+        if (its)
+            its[r].t = std::numeric_limits<float>::infinity();
+        f[r] = 0;
+
+        /* Use an adaptive ray epsilon */
+        Ray3f &ray = rays[r];
+        ray = _rays[r];
+        if (ray.mint == Epsilon)
+            ray.mint = std::max(ray.mint, ray.mint * ray.o.array().abs().maxCoeff());
+
+        for (int i = 0; i < 3; ++i) {
+            packet.o[i][r] = ray.o[i];
+            packet.dRcp[i][r] = ray.dRcp[i];
+        }
+        packet.mint[r] = ray.mint;
+        packet.maxt[r] = ray.maxt;
+
+        float nearT;
+        if (!m_wideNodes.empty() && ray.mint <= ray.maxt && m_bbox.rayIntersect(ray, nearT)) {
+            active |= 1u << r;
+            rootNearT = std::min(rootNearT, nearT);
+        }
+    }
+
+    /* Every wide node counts as one visit for each ray that is tested against it */
+    uint64_t nodeVisits = 0, primitiveTests = 0;
+
+    StackEntry current { 0, 0, active, rootNearT };
+    bool hit = active != 0;
+
+    while (hit) {
+        if ((current.mask & (current.mask - 1)) == 0) {
+            /* Only one ray is left, which is faster on its own */
+            uint32_t r = 0;
+            while (!(current.mask & (1u << r)))
+                ++r;
+            if (traverse(current.child, current.count, rays[r], its ? its[r] : unused, f[r],
+                         shadowRay, nodeVisits, primitiveTests)) {
+                found |= 1u << r;
+                packet.maxt[r] = rays[r].maxt;
+            }
+        } else if (current.count == 0) {
+            const WideNode &node = m_wideNodes[current.child];
+            alignas(16) float childNearT[4][PacketSize];
+            NORI_STATS_ONLY(for (uint32_t r = 0; r < count; ++r)
+                                nodeVisits += (current.mask >> r) & 1);
+
+            /* Test the children against all rays of the packet that reached the node,
+               and visit them front to back for the packet as a whole */
+            StackEntry children[4];
+            int childIndex[4];
+            int hitCount = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (node.bounds[0][i] > node.bounds[3][i])
+                    continue; /* Unused */
+                float nearT;
+                uint32_t mask = intersectChildPacket(node.bounds, i, packet, current.mask,
+                                                     childNearT[i], nearT);
+                if (mask == 0)
+                    continue;
+                StackEntry entry { node.child[i], node.count[i], mask, nearT };
+                int j = hitCount++;
+                if (!shadowRay) {
+                    for (; j > 0 && children[j - 1].nearT > entry.nearT; --j) {
+                        children[j] = children[j - 1];
+                        childIndex[j] = childIndex[j - 1];
+                    }
+                }
+                children[j] = entry;
+                childIndex[j] = i;
+            }
+
+            if (hitCount > 0) {
+                for (int i = hitCount - 1; i > 0; --i) {
+                    memcpy(stackNearT[stack_idx], childNearT[childIndex[i]], sizeof(float) * PacketSize);
+                    stack[stack_idx++] = children[i];
+                }
+                assert(stack_idx <= 3 * 64);
+                current = children[0];
+                continue;
+            }
         } else {
-            for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
-                uint32_t idx = m_indices[i];
-                const Shape *shape = m_shapes[findShape(idx)];
-
-                float u, v, t;
-                if (shape->rayIntersect(idx, ray, u, v, t)) {
-                    if (shadowRay)
-                        return true;
-                    foundIntersection = true;
-                    ray.maxt = its.t = t;
-                    its.uv = Point2f(u, v);
-                    its.mesh = shape;
-                    f = idx;
+            for (uint32_t r = 0; r < count; ++r) {
+                if (!(current.mask & (1u << r)))
+                    continue;
+                if (intersectLeaf(current.child, current.child + current.count, rays[r],
+                                  its ? its[r] : unused, f[r], shadowRay, primitiveTests)) {
+                    found |= 1u << r;
+                    packet.maxt[r] = rays[r].maxt;
                 }
             }
-            if (stack_idx == 0)
+
+            /* All shadow rays are occluded */
+            if (shadowRay && found == active)
                 break;
-            node_idx = stack[--stack_idx];
-            continue;
         }
-    }
 
-    if (foundIntersection) {
-        its.mesh->setHitInformation(f,ray,its);
+        /* Continue with the most recently pushed child, but only with those
+           rays that enter it before their closest intersection so far (and
+           that aren't occluded yet, for shadow rays) */
+        hit = false;
+        while (stack_idx > 0) {
+            const StackEntry &entry = stack[--stack_idx];
+            uint32_t mask = activeRays(stackNearT[stack_idx], packet,
+                                       shadowRay ? entry.mask & ~found : entry.mask);
+            if (mask != 0) {
+                current = entry;
+                current.mask = mask;
+                hit = true;
+                break;
+            }
+        }
     }
 
-    return foundIntersection;
+    NORI_STATS_ADD(EBVHNodeVisits, nodeVisits);
+    NORI_STATS_ADD(EPrimitiveTests, primitiveTests);
+
+    for (uint32_t r = 0; r < count; ++r) {
+        hits[r] = (found & (1u << r)) != 0;
+        if (hits[r] && !shadowRay)
+            its[r].mesh->setHitInformation(f[r], rays[r], its[r]);
+    }
 }
 
 NORI_NAMESPACE_END
@@ -0,0 +1,94 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/cache.h>
+#include <nori/profiler.h>
+#include <fstream>
+#include "stb_image.h"
+
+NORI_NAMESPACE_BEGIN
+
+void AssetCache::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = enabled;
+    if (!enabled)
+        m_entries.clear();
+}
+
+void AssetCache::beginJob(int keepJobs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_job++;
+    m_hits = m_misses = 0;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+        if (it->second.lastJob + keepJobs < m_job)
+            it = m_entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::string AssetCache::getStatistics() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return tfm::format("%i assets reused, %i loaded, %i cached", m_hits, m_misses, m_entries.size());
+}
+
+uint64_t AssetCache::hash(const void *data, size_t size, uint64_t hash) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t AssetCache::hashFile(const std::string &filename) {
+    std::ifstream is(filename, std::ios::binary);
+    if (is.fail())
+        throw NoriException("Unable to open \"%s\"!", filename);
+
+    uint64_t result = hash(nullptr, 0);
+    std::unique_ptr<char[]> buffer(new char[1 << 20]);
+    while (is) {
+        is.read(buffer.get(), 1 << 20);
+        result = hash(buffer.get(), (size_t) is.gcount(), result);
+    }
+    return result;
+}
+
+AssetCache *getAssetCache() {
+    static AssetCache *cache = new AssetCache();
+    return cache;
+}
+
+LDRImage::~LDRImage() {
+    if (data)
+        stbi_image_free(data);
+}
+
+std::shared_ptr<LDRImage> loadLDRImage(const std::string &filename) {
+    return getAssetCache()->get<LDRImage>("image",
+        [&] { return AssetCache::hashFile(filename); },
+        [&] {
+            ProfileZone zone("decode texture", filename);
+            std::shared_ptr<LDRImage> image(new LDRImage());
+            image->data = stbi_load(filename.c_str(), &image->width, &image->height, &image->channels, 0);
+            return image;
+        });
+}
+
+NORI_NAMESPACE_END
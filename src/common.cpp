@@ -248,6 +248,36 @@ Transform Transform::operator*(const Transform &t) const {
         t.m_inverse * m_inverse);
 }
 
+void AnimatedTransform::addKeyframe(float frame, const Transform &trafo) {
+    if (!m_keyframes.insert(std::make_pair(frame, trafo)).second)
+        throw NoriException("Keyframe %f was specified multiple times!", frame);
+}
+
+Transform AnimatedTransform::eval(float frame) const {
+    if (m_keyframes.empty())
+        return Transform();
+
+    auto next = m_keyframes.lower_bound(frame);
+    if (next == m_keyframes.begin())
+        return next->second;
+    if (next == m_keyframes.end())
+        return std::prev(next)->second;
+    auto prev = std::prev(next);
+    float t = (frame - prev->first) / (next->first - prev->first);
+
+    /* Decompose both keyframes into rotation, scale and translation */
+    Eigen::Affine3f a(prev->second.getMatrix()), b(next->second.getMatrix());
+    Eigen::Matrix3f rotationA, scaleA, rotationB, scaleB;
+    a.computeRotationScaling(&rotationA, &scaleA);
+    b.computeRotationScaling(&rotationB, &scaleB);
+
+    Eigen::Quaternionf rotation = Eigen::Quaternionf(rotationA).slerp(t, Eigen::Quaternionf(rotationB));
+    Eigen::Affine3f result = Eigen::Affine3f::Identity();
+    result.linear() = rotation.toRotationMatrix() * ((1 - t) * scaleA + t * scaleB);
+    result.translation() = (1 - t) * a.translation() + t * b.translation();
+    return Transform(result.matrix());
+}
+
 Vector3f sphericalDirection(float theta, float phi) {
     float sinTheta, cosTheta, sinPhi, cosPhi;
 
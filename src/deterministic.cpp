@@ -0,0 +1,112 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Counter-based independent sampling - returns uniformly distributed
+ * random numbers on <tt>[0, 1)x[0, 1)</tt> like \ref Independent.
+ *
+ * Instead of consuming a random number stream per block, every value is a
+ * hash of the seed, the pixel, the sample index and the dimension (the
+ * number of values that were requested for the pixel sample so far). The
+ * rendered image therefore doesn't depend on how the image is split into
+ * blocks or on the order in which they are rendered, which allows to
+ * validate changes of the renderer by comparing images bit by bit.
+ */
+class Deterministic : public Sampler {
+public:
+    Deterministic(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Deterministic() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Deterministic> cloned(new Deterministic());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
+        cloned->m_key = m_key;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &block) { /* The values don't depend on the block */ }
+
+    void generate() { /* No-op for this sampler */ }
+    void advance()  { /* No-op for this sampler */ }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension) {
+        uint64_t position = ((uint64_t) (uint32_t) pixel.x() << 32) | (uint32_t) pixel.y();
+        m_key = mix(position ^ mix(((uint64_t) m_seed << 32) | sampleIndex));
+        m_dimension = dimension;
+    }
+
+    float next1D() {
+        return value(m_dimension++);
+    }
+
+    Point2f next2D() {
+        float x = value(m_dimension++);
+        float y = value(m_dimension++);
+        return Point2f(x, y);
+    }
+
+    bool isCounterBased() const { return true; }
+
+    void saveState(std::ostream &stream) const {
+        stream.write(reinterpret_cast<const char *>(&m_key), sizeof(m_key));
+        stream.write(reinterpret_cast<const char *>(&m_dimension), sizeof(m_dimension));
+    }
+
+    void loadState(std::istream &stream) {
+        stream.read(reinterpret_cast<char *>(&m_key), sizeof(m_key));
+        stream.read(reinterpret_cast<char *>(&m_dimension), sizeof(m_dimension));
+    }
+
+    virtual std::string toString() const override {
+        return tfm::format("Deterministic[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Deterministic() { }
+
+    /// Finalizer of SplitMix64, a bijection with good avalanche behavior
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    /// Return the value of a dimension of the current pixel sample
+    float value(uint64_t dimension) const {
+        /* SplitMix64 with the key as the state, keep 24 bits for an exact float in [0, 1) */
+        uint64_t bits = mix(m_key + (dimension + 1) * 0x9e3779b97f4a7c15ull);
+        return (float) (bits >> 40) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint64_t m_key = 0;
+    uint64_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Deterministic, "deterministic");
+NORI_NAMESPACE_END
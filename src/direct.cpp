@@ -15,7 +15,6 @@ public:
         if (!scene->rayIntersect(ray, its))
             return Color3f(0.0f);
 
-        auto normal = its.shFrame.n;
         Color3f finalColor{0.0f};
         Vector2f sample;
 
@@ -28,14 +27,7 @@ public:
                 continue;
             }
 
-            BSDFQueryRecord bsdfRecord{its.shFrame.toLocal(emitterRecord.wi), its.shFrame.toLocal(-ray.d), ESolidAngle};
-            bsdfRecord.p = its.p;
-            bsdfRecord.uv = its.uv;
-
-            auto shadowRay = emitterRecord.shadowRay.d;
-            auto cosTheta = normal.dot(shadowRay);
-
-            finalColor += its.mesh->getBSDF()->eval(bsdfRecord) * incidentRadiance * abs(cosTheta);
+            finalColor += shade(its, ray, emitterRecord, incidentRadiance);
         }
 
         // finalColor = 1/N * sum((f(p, wo, wi) * L(p,wi) * |cos(theta_i)|) / p(wi))
@@ -43,9 +35,66 @@ public:
         return finalColor;
     }
 
+    void LiPacket(const Scene *scene, Sampler *sampler, const Ray3f *rays,
+            const Intersection *its, const bool *hits, uint32_t count,
+            const std::function<void(uint32_t)> &startSample, Color3f *finalColor) const {
+        assert(count <= BVH::PacketSize);
+        Vector2f sample;
+
+        for (uint32_t i = 0; i < count; ++i)
+            finalColor[i] = Color3f(0.0f);
+
+        for (auto light : scene->getLights()) {
+            EmitterQueryRecord emitterRecords[BVH::PacketSize];
+            Color3f incidentRadiance[BVH::PacketSize];
+            Ray3f shadowRays[BVH::PacketSize];
+            bool occluded[BVH::PacketSize];
+            uint32_t pixels[BVH::PacketSize], n = 0;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!hits[i])
+                    continue;
+                emitterRecords[n].ref = its[i].p;
+                emitterRecords[n].uv = its[i].uv;
+                incidentRadiance[n] = light->sample(emitterRecords[n], sample);
+                shadowRays[n] = emitterRecords[n].shadowRay;
+                pixels[n++] = i;
+            }
+
+            // The shadow rays of neighboring pixels towards the same light are coherent, trace them together
+            scene->rayIntersect(shadowRays, n, occluded);
+
+            for (uint32_t k = 0; k < n; ++k) {
+                if (occluded[k]) {
+                    continue;
+                }
+                uint32_t i = pixels[k];
+                finalColor[i] += shade(its[i], rays[i], emitterRecords[k], incidentRadiance[k]);
+            }
+        }
+    }
+
+    bool acceptsIntersections() const { return true; }
+
     std::string toString() const {
         return "DirectIntegrator[]";
     }
+
+private:
+    /// Contribution of an unoccluded light sample
+    Color3f shade(const Intersection &its, const Ray3f &ray, const EmitterQueryRecord &emitterRecord,
+            const Color3f &incidentRadiance) const {
+        auto normal = its.shFrame.n;
+
+        BSDFQueryRecord bsdfRecord{its.shFrame.toLocal(emitterRecord.wi), its.shFrame.toLocal(-ray.d), ESolidAngle};
+        bsdfRecord.p = its.p;
+        bsdfRecord.uv = its.uv;
+
+        auto shadowRay = emitterRecord.shadowRay.d;
+        auto cosTheta = normal.dot(shadowRay);
+
+        return its.mesh->getBSDF()->eval(bsdfRecord) * incidentRadiance * abs(cosTheta);
+    }
 };
 
 NORI_REGISTER_CLASS(DirectIntegrator, "direct");
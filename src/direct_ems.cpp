@@ -25,16 +25,7 @@ public:
 
             if (scene->rayIntersect(emitterRecord.shadowRay)) continue;
 
-            auto wi = its.shFrame.toLocal(emitterRecord.wi);
-
-            BSDFQueryRecord bsdfRecord{its.shFrame.toLocal(-ray.d), wi, ESolidAngle};
-            bsdfRecord.p = its.p;
-            bsdfRecord.uv = its.uv;
-
-            auto shadowRay = emitterRecord.shadowRay.d;
-            auto cosTheta = Frame::cosTheta(wi);
-
-            Lo += its.mesh->getBSDF()->eval(bsdfRecord) * LeDivPdf * cosTheta;
+            Lo += shade(its, ray, emitterRecord, LeDivPdf);
         }
 
         if (its.mesh->isEmitter()) {
@@ -46,9 +37,83 @@ public:
         return Lo;
     }
 
+    void LiPacket(const Scene *scene, Sampler *sampler, const Ray3f *rays,
+            const Intersection *its, const bool *hits, uint32_t count,
+            const std::function<void(uint32_t)> &startSample, Color3f *Lo) const {
+        struct LightSample {
+            EmitterQueryRecord emitterRecord;
+            Color3f LeDivPdf;
+            bool occluded;
+        };
+        const std::vector<Emitter *> &lights = scene->getLights();
+        std::vector<LightSample> samples(lights.size() * count);     // samples[light * count + pixel]
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!hits[i]) continue;
+            startSample(i);
+
+            for (size_t j = 0; j < lights.size(); ++j) {
+                LightSample &s = samples[j * count + i];
+                s.emitterRecord.ref = its[i].p;
+                s.emitterRecord.uv = its[i].uv;
+                s.LeDivPdf = lights[j]->sample(s.emitterRecord, sampler->next2D());       // Le / pdf_em
+            }
+        }
+
+        // The shadow rays of neighboring pixels towards the same light are coherent, trace them together
+        assert(count <= BVH::PacketSize);
+        for (size_t j = 0; j < lights.size(); ++j) {
+            Ray3f shadowRays[BVH::PacketSize];
+            bool occluded[BVH::PacketSize];
+            uint32_t pixels[BVH::PacketSize], n = 0;
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!hits[i]) continue;
+                shadowRays[n] = samples[j * count + i].emitterRecord.shadowRay;
+                pixels[n++] = i;
+            }
+            scene->rayIntersect(shadowRays, n, occluded);
+            for (uint32_t k = 0; k < n; ++k)
+                samples[j * count + pixels[k]].occluded = occluded[k];
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            Lo[i] = Color3f(0.0f);
+            if (!hits[i]) continue;
+
+            for (size_t j = 0; j < lights.size(); ++j) {
+                const LightSample &s = samples[j * count + i];
+                if (s.occluded) continue;
+                Lo[i] += shade(its[i], rays[i], s.emitterRecord, s.LeDivPdf);
+            }
+
+            if (its[i].mesh->isEmitter()) {
+                EmitterQueryRecord emitterRecord{rays[i].o, its[i].p, its[i].shFrame.n};
+                emitterRecord.uv = its[i].uv;
+                Lo[i] += its[i].mesh->getEmitter()->eval(emitterRecord);   // add Le
+            }
+        }
+    }
+
+    bool acceptsIntersections() const { return true; }
+
     std::string toString() const {
         return "DirectEmsIntegrator[]";
     }
+
+private:
+    /// Contribution of an unoccluded light sample
+    Color3f shade(const Intersection &its, const Ray3f &ray, const EmitterQueryRecord &emitterRecord,
+            const Color3f &LeDivPdf) const {
+        auto wi = its.shFrame.toLocal(emitterRecord.wi);
+
+        BSDFQueryRecord bsdfRecord{its.shFrame.toLocal(-ray.d), wi, ESolidAngle};
+        bsdfRecord.p = its.p;
+        bsdfRecord.uv = its.uv;
+
+        auto cosTheta = Frame::cosTheta(wi);
+
+        return its.mesh->getBSDF()->eval(bsdfRecord) * LeDivPdf * cosTheta;
+    }
 };
 
 NORI_REGISTER_CLASS(DirectEmsIntegrator, "direct_ems");
@@ -2,6 +2,8 @@
 #include <nori/scene.h>
 #include <nori/bitmap.h>
 #include <nori/warp.h>
+#include <nori/cache.h>
+#include <nori/profiler.h>
 
 NORI_NAMESPACE_BEGIN
 using namespace std;
@@ -12,12 +14,17 @@ public:
     Environment(const PropertyList &props) {
         m_mapPath = props.getString("filename");
         m_interpolate = props.getBoolean("interpolate", true);
-        m_envBitMap = Bitmap(m_mapPath);
+        m_envBitMap = getAssetCache()->get<Bitmap>("bitmap",
+            [&] { return AssetCache::hashFile(m_mapPath); },
+            [&] {
+                ProfileZone zone("decode texture", m_mapPath);
+                return std::make_shared<Bitmap>(m_mapPath);
+            });
         buildIntensity();
     }  
 
     VectorXf computeCDF(VectorXf PDFVec) {
-        auto n = m_envBitMap.rows();
+        auto n = m_envBitMap->rows();
         auto res = VectorXf(n+1);
         res(0) = 0;
 
@@ -30,15 +37,15 @@ public:
     } 
 
     void buildIntensity() {
-        auto nRow = m_envBitMap.rows();
-        auto nCol = m_envBitMap.cols();
+        auto nRow = m_envBitMap->rows();
+        auto nCol = m_envBitMap->cols();
 
         // Init the intensity matrix otherwise core dump
         intensity = MatrixXf(nRow,nCol);
 
         for(int i = 0; i < nRow; i++) {
             for(int j = 0; j < nCol; j++) {
-                float val = m_envBitMap(i, j).getLuminance();
+                float val = (*m_envBitMap)(i, j).getLuminance();
 
                 float sinTheta = sin(M_PI * i / (nRow));
                 intensity(i, j) = val * sinTheta; 
@@ -87,8 +94,8 @@ public:
     }
 
     Color3f sample(EmitterQueryRecord &lRec, const Point2f &sample) const override {
-        auto nRow = m_envBitMap.rows() - 1;
-        auto nCol = m_envBitMap.cols() - 1;
+        auto nRow = m_envBitMap->rows() - 1;
+        auto nCol = m_envBitMap->cols() - 1;
 
         // From PBRT BOOK --> use SampleDiscrete instead of SampleContinuous
         auto i = sampleDiscrete(rowCDF, sample.x());
@@ -111,8 +118,8 @@ public:
         auto normal = sphericalCoordinates(lRec.wi);
 
         // Use row-1 to avoid IndexOutOfBounds
-        int nRow = m_envBitMap.rows() - 1;
-        int nCol = m_envBitMap.cols() - 1;
+        int nRow = m_envBitMap->rows() - 1;
+        int nCol = m_envBitMap->cols() - 1;
         
         // Not the same conversion as in sphere.cpp
         auto x = normal.x() * nRow * INV_PI;
@@ -122,7 +129,7 @@ public:
             int u = int(round(x));
             int v = int(round(y));
 
-            return m_envBitMap(u, v);
+            return (*m_envBitMap)(u, v);
         }
 
         // https://helloacm.com/cc-function-to-compute-the-bilinear-interpolation/
@@ -137,10 +144,10 @@ public:
         auto y1 = clamp(bottomY, 0, nCol);
         auto y2 = clamp(topY, 0, nCol);
 
-        auto q11 = m_envBitMap(x1, y1);
-        auto q12 = m_envBitMap(x1, y2);
-        auto q21 = m_envBitMap(x2, y1);
-        auto q22 = m_envBitMap(x2, y2);
+        auto q11 = (*m_envBitMap)(x1, y1);
+        auto q12 = (*m_envBitMap)(x1, y2);
+        auto q21 = (*m_envBitMap)(x2, y1);
+        auto q22 = (*m_envBitMap)(x2, y2);
 
         auto xDiff = x - x1;
         auto yDiff = y - y1;
@@ -153,8 +160,8 @@ public:
 
     float pdf(const EmitterQueryRecord &lRec) const override {
         auto normal = sphericalCoordinates(lRec.wi);
-        auto nRow = m_envBitMap.rows() - 1;
-        auto nCol = m_envBitMap.cols() - 1;
+        auto nRow = m_envBitMap->rows() - 1;
+        auto nCol = m_envBitMap->cols() - 1;
 
         // From Sphere.cpp 
         auto x = normal.x() * nRow * INV_PI;
@@ -178,7 +185,7 @@ public:
 private:
     MatrixXf intensity;
     string m_mapPath;
-    Bitmap m_envBitMap;
+    std::shared_ptr<const Bitmap> m_envBitMap; ///< Shared with the asset cache
     bool m_interpolate;
 
     VectorXf rowPDF;
@@ -4,6 +4,9 @@
 #define NANOVDB_USE_ZIP 1
 #include <nanovdb/util/IO.h>
 #include <nori/perlinnoise.h>
+#include <nori/cache.h>
+#include <nori/stats.h>
+#include <nori/profiler.h>
 
 // Possible density types
 #define EXPONENTIAL 0
@@ -58,11 +61,16 @@ public:
             m_non_transformed_bbox_size = 2 * size;
 
             auto filename = getFileResolver()->resolve(props.getString("volume_grid")).str();
-            m_handle = nanovdb::io::readGrid(filename);
+            m_handle = getAssetCache()->get<nanovdb::GridHandle<nanovdb::HostBuffer>>("nanovdb",
+                [&] { return AssetCache::hashFile(filename); },
+                [&] {
+                    ProfileZone zone("NanoVDB load", filename);
+                    return std::make_shared<nanovdb::GridHandle<nanovdb::HostBuffer>>(nanovdb::io::readGrid(filename));
+                });
             m_density_grid = nullptr;
 
-            for (uint32_t i = 0; i < m_handle.gridCount(); i++) {
-                auto *curr_grid = m_handle.grid<float>(i);
+            for (uint32_t i = 0; i < m_handle->gridCount(); i++) {
+                auto *curr_grid = m_handle->grid<float>(i);
                 if (strcmp(curr_grid->gridName(), "density") == 0) {
                     m_density_grid = curr_grid;
                     break;
@@ -88,6 +96,7 @@ public:
             m_density_grid_bbox = BoundingBox3f{grid_bbox_min, grid_bbox_max};
             m_density_grid_bbox_size = m_density_grid_bbox.max - m_density_grid_bbox.min;
 
+            ProfileZone zone("NanoVDB majorant scan", filename);
             m_max_density = 0.0f;
             auto accessor = m_density_grid->getAccessor();
             float curr_density;
@@ -135,9 +144,11 @@ public:
         float tMax = std::min(mRec.tMax, farT);
         Color3f tr{1.0f};
         float densityDivSigmaT = m_inv_max_density / m_sigma_t.maxCoeff();
+        NORI_STATS_ONLY(uint64_t steps = 0);
 
         while (true) {
             t -= log(1.0f - sampler->next1D()) * densityDivSigmaT;
+            NORI_STATS_ONLY(steps++);
 
             if (t >= tMax) {
                 break;
@@ -146,6 +157,7 @@ public:
             tr *= 1.0f - std::max(0.0f, getDensity(ray(t)) * m_inv_max_density);
         }
         
+        NORI_STATS_ADD(EMediumTrSteps, steps);
         return tr;
     }
 
@@ -167,9 +179,11 @@ public:
         }
 
         float densityDivSigmaT = m_inv_max_density / m_sigma_t.maxCoeff();
+        NORI_STATS_ONLY(uint64_t steps = 0);
 
         while (true) {
             t -= log(1.0f - sampler->next1D()) * densityDivSigmaT;
+            NORI_STATS_ONLY(steps++);
 
             if (t >= tMax) {
                 mRec.hasInteraction = false;
@@ -179,10 +193,12 @@ public:
             if (sampler->next1D() < getDensity(ray(t)) * m_inv_max_density) {
                 mRec.hasInteraction = true;
                 mRec.p = ray(t);
+                NORI_STATS_ADD(EMediumSampleSteps, steps);
                 return m_albedo;
             }
         }
         
+        NORI_STATS_ADD(EMediumSampleSteps, steps);
         return Color3f{1.0f};
     }
 
@@ -258,7 +274,7 @@ private:
     Point3f m_non_transformed_bbox_size;
     nanovdb::FloatGrid* m_density_grid;
     // For some reason, NanoVDB getValue in getGridDensity() only works if I leave the handle as a class property...
-    nanovdb::GridHandle<nanovdb::HostBuffer> m_handle;
+    std::shared_ptr<nanovdb::GridHandle<nanovdb::HostBuffer>> m_handle; // shared with the asset cache
 
     // used to transform back positions inside the volume
     Transform m_inv_transform;
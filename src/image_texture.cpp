@@ -18,6 +18,7 @@
 
 #include <nori/object.h>
 #include <nori/texture.h>
+#include <nori/cache.h>
 #include <filesystem/resolver.h>
 #include "stb_image.h"
 
@@ -31,7 +32,11 @@ public:
         m_shift = props.getVector2("shift", Vector2f(0.0f));
         m_linear_rgb = props.getBoolean("linear_rgb", true);
 
-        m_image = stbi_load(m_filename.c_str(), &m_width, &m_height, &m_channels, 0);
+        m_data = loadLDRImage(m_filename);
+        m_image = m_data->data;
+        m_width = m_data->width;
+        m_height = m_data->height;
+        m_channels = m_data->channels;
 
         if (m_image == NULL) {
             tfm::printfln("Error: Loading image texture '%s' failed\n\t%s", m_filename, stbi_failure_reason());
@@ -68,6 +73,7 @@ public:
 
 protected:
     std::string m_filename;
+    std::shared_ptr<LDRImage> m_data; ///< Owns m_image (shared with the asset cache)
     unsigned char *m_image;
     int m_height;
     int m_width;
@@ -34,6 +34,7 @@ class Independent : public Sampler {
 public:
     Independent(const PropertyList &propList) {
         m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
     }
 
     virtual ~Independent() { }
@@ -41,13 +42,15 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
         cloned->m_random = m_random;
         return std::move(cloned);
     }
 
     void prepare(const ImageBlock &block) {
+        /* The seed offset selects a different initial state for every block */
         m_random.seed(
-            block.getOffset().x(),
+            block.getOffset().x() + ((uint64_t) m_seed << 32),
             block.getOffset().y()
         );
     }
@@ -66,8 +69,18 @@ public:
         );
     }
 
+    void saveState(std::ostream &stream) const {
+        stream.write(reinterpret_cast<const char *>(&m_random.state), sizeof(m_random.state));
+        stream.write(reinterpret_cast<const char *>(&m_random.inc), sizeof(m_random.inc));
+    }
+
+    void loadState(std::istream &stream) {
+        stream.read(reinterpret_cast<char *>(&m_random.state), sizeof(m_random.state));
+        stream.read(reinterpret_cast<char *>(&m_random.inc), sizeof(m_random.inc));
+    }
+
     virtual std::string toString() const override {
-        return tfm::format("Independent[sampleCount=%i]", m_sampleCount);
+        return tfm::format("Independent[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
     }
 protected:
     Independent() { }
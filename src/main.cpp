@@ -18,12 +18,406 @@
 
 #include <nori/block.h>
 #include <nori/gui.h>
+#include <nori/render.h>
+#include <nori/cache.h>
+#include <nori/socket.h>
+#include <nori/timer.h>
 #include <filesystem/path.h>
+#include <filesystem/resolver.h>
+#include <tbb/task_scheduler_init.h>
+#include <cstdio>
+#if !defined(_WIN32)
+#include <unistd.h>
+#else
+#include <direct.h>
+#define chdir _chdir
+#endif
+
+using namespace nori;
+
+static void printUsage() {
+    cout << "Syntax: nori [scene.xml | image.exr]" << endl
+         << "        nori --render scene.xml [options]" << endl
+         << "        nori --worker <host:port> [--threads <count>]" << endl
+         << "        nori --daemon <socket> [--threads <count>]" << endl
+         << "        nori --submit <socket> scene.xml [options] | --shutdown" << endl
+         << endl
+         << "Options for headless rendering (no window is opened):" << endl
+         << "   --threads <count>    Number of render threads (default: all cores)" << endl
+         << "   --spp <count>        Override the sample count of the scene" << endl
+         << "   --seed <value>       Seed offset of the sampler (renderings with different" << endl
+         << "                        seeds can be combined with nori-merge)" << endl
+         << "   --deterministic      Use counter-based sampling, so that the image doesn't" << endl
+         << "                        depend on the threads, block size or workers" << endl
+         << "   --scale <factor>     Scale the resolution of the camera (e.g. 0.5)" << endl
+         << "   --crop <x>,<y>,<width>,<height>" << endl
+         << "                        Only render this window of the image (with" << endl
+         << "                        --deterministic, exactly as in the full image)" << endl
+         << "   --output <file.exr>  Output file (default: scene name with .exr)" << endl
+         << "   --samples-per-task <count>" << endl
+         << "                        Samples rendered per block and task (default: 8)" << endl
+         << "   --block-size <size>  Size of the blocks the image is split into (default: 32)" << endl
+         << "   --no-variance        Don't write the \"_variance.exr\" file" << endl
+         << "   --cost               Write the render time of every pixel to \"_cost.exr\"" << endl
+         << "   --stats <file.json>  Write ray and shading statistics (requires a build" << endl
+         << "                        with NORI_ENABLE_STATS)" << endl
+         << "   --trace <file.json>  Write a timeline of loading and rendering in the" << endl
+         << "                        Chrome trace event format (chrome://tracing)" << endl
+         << "   --adaptive <error>   Keep refining blocks until their relative error is" << endl
+         << "                        below <error> or the sample count is reached" << endl
+         << "   --adaptive-base <count>" << endl
+         << "                        Samples per pixel before refinement starts (default: 16)" << endl
+         << "   --time-budget <seconds>" << endl
+         << "                        Stop rendering after the given wall-clock time" << endl
+         << "   --target-variance <value>" << endl
+         << "                        Stop once the mean relative variance drops below <value>" << endl
+         << "                        (with either of these, passes continue until the limit" << endl
+         << "                        is hit; --spp then only acts as an upper bound)" << endl
+         << "   --checkpoint <seconds>" << endl
+         << "                        Periodically save the progress to \"<output>.checkpoint\"" << endl
+         << "   --snapshot <seconds> Periodically write the image in progress to the output" << endl
+         << "   --snapshot-passes <count>" << endl
+         << "                        Also write it after every <count> passes" << endl
+         << "   --resume             Continue from the checkpoint of a previous rendering" << endl
+         << "                        (which must use the same scene and options)" << endl
+         << "   --listen <port>      Let worker processes render the blocks (see --worker)" << endl
+         << "   --frames <first>:<last>" << endl
+         << "                        Render these frames of the animation (camera and shape" << endl
+         << "                        keyframes) into \"<output>_<frame>.exr\" files" << endl
+         << endl
+         << "Distributed rendering:" << endl
+         << "   --worker <host:port> Render blocks for \"nori --render --listen <port>\" on" << endl
+         << "                        <host>, with one connection per thread" << endl
+         << endl
+         << "Render daemon (keeps meshes, textures, volumes and BVHs loaded between jobs):" << endl
+         << "   --daemon <socket>    Render the jobs submitted to this Unix domain socket" << endl
+         << "   --submit <socket> scene.xml [options]" << endl
+         << "                        Render with the daemon and wait until it is done" << endl
+         << "   --submit <socket> --shutdown" << endl
+         << "                        Stop the daemon" << endl
+         << endl
+         << "Exit codes: 0 on success, 1 on invalid arguments, 2 if rendering failed." << endl;
+}
+
+/**
+ * \brief Parse the headless rendering option at <tt>args[i]</tt>
+ *
+ * \c i is advanced past the value of the option.
+ * \return \c false if the argument isn't a rendering option
+ */
+static bool parseRenderOption(const std::vector<std::string> &args, size_t &i, RenderOptions &options) {
+    const std::string &arg = args[i];
+    bool hasValue = i + 1 < args.size();
+
+    if (arg == "--threads" && hasValue) {
+        options.threadCount = toInt(args[++i]);
+        if (options.threadCount <= 0)
+            throw NoriException("The thread count must be positive!");
+    } else if (arg == "--spp" && hasValue) {
+        options.sampleCount = toInt(args[++i]);
+        if (options.sampleCount <= 0)
+            throw NoriException("The sample count must be positive!");
+    } else if (arg == "--seed" && hasValue) {
+        options.seed = toInt(args[++i]);
+        if (options.seed < 0)
+            throw NoriException("The seed must not be negative!");
+    } else if (arg == "--deterministic") {
+        options.deterministic = true;
+    } else if (arg == "--scale" && hasValue) {
+        options.resolutionScale = toFloat(args[++i]);
+        if (!(options.resolutionScale > 0))
+            throw NoriException("The resolution scale must be positive!");
+    } else if (arg == "--crop" && hasValue) {
+        std::vector<std::string> values = tokenize(args[++i], ",");
+        if (values.size() != 4)
+            throw NoriException("The crop window must be given as <x>,<y>,<width>,<height>!");
+        options.cropOffset = Point2i(toInt(values[0]), toInt(values[1]));
+        options.cropSize = Vector2i(toInt(values[2]), toInt(values[3]));
+        if ((options.cropSize.array() <= 0).any())
+            throw NoriException("The size of the crop window must be positive!");
+    } else if (arg == "--samples-per-task" && hasValue) {
+        options.samplesPerTask = toInt(args[++i]);
+        if (options.samplesPerTask <= 0)
+            throw NoriException("The number of samples per task must be positive!");
+    } else if (arg == "--block-size" && hasValue) {
+        options.blockSize = toInt(args[++i]);
+        if (options.blockSize <= 0)
+            throw NoriException("The block size must be positive!");
+    } else if (arg == "--output" && hasValue) {
+        options.outputName = args[++i];
+    } else if (arg == "--stats" && hasValue) {
+        options.statsName = args[++i];
+    } else if (arg == "--trace" && hasValue) {
+        options.traceName = args[++i];
+    } else if (arg == "--cost") {
+        options.computeCost = true;
+    } else if (arg == "--no-variance") {
+        options.computeVariance = false;
+    } else if (arg == "--adaptive" && hasValue) {
+        options.adaptive = true;
+        options.adaptiveThreshold = toFloat(args[++i]);
+        if (options.adaptiveThreshold <= 0)
+            throw NoriException("The adaptive error threshold must be positive!");
+    } else if (arg == "--adaptive-base" && hasValue) {
+        options.adaptiveBaseSamples = toInt(args[++i]);
+        if (options.adaptiveBaseSamples < 2)
+            throw NoriException("Adaptive sampling needs at least 2 base samples!");
+    } else if (arg == "--time-budget" && hasValue) {
+        options.timeBudget = toFloat(args[++i]);
+        if (options.timeBudget <= 0)
+            throw NoriException("The time budget must be positive!");
+    } else if (arg == "--target-variance" && hasValue) {
+        options.targetVariance = toFloat(args[++i]);
+        if (options.targetVariance <= 0)
+            throw NoriException("The target variance must be positive!");
+    } else if (arg == "--checkpoint" && hasValue) {
+        options.checkpointInterval = toFloat(args[++i]);
+        if (options.checkpointInterval <= 0)
+            throw NoriException("The checkpoint interval must be positive!");
+    } else if (arg == "--snapshot" && hasValue) {
+        options.snapshotInterval = toFloat(args[++i]);
+        if (options.snapshotInterval <= 0)
+            throw NoriException("The snapshot interval must be positive!");
+    } else if (arg == "--snapshot-passes" && hasValue) {
+        options.snapshotPasses = toInt(args[++i]);
+        if (options.snapshotPasses <= 0)
+            throw NoriException("The number of passes between snapshots must be positive!");
+    } else if (arg == "--resume") {
+        options.resume = true;
+    } else if (arg == "--listen" && hasValue) {
+        options.listenPort = toInt(args[++i]);
+        if (options.listenPort <= 0 || options.listenPort > 65535)
+            throw NoriException("Invalid port number %i!", options.listenPort);
+    } else if (arg == "--frames" && hasValue) {
+        std::vector<std::string> range = tokenize(args[++i], ":");
+        if (range.size() != 2)
+            throw NoriException("Expected a frame range as \"<first>:<last>\", got \"%s\"!", args[i]);
+        options.firstFrame = toInt(range[0]);
+        options.lastFrame = toInt(range[1]);
+        if (!options.isSequence())
+            throw NoriException("The frame range %s is empty!", args[i]);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// Parse the arguments of a job for the render daemon ("scene.xml [options]")
+static std::string parseJob(const std::vector<std::string> &args, RenderOptions &options) {
+    std::string filename;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (parseRenderOption(args, i, options))
+            continue;
+        if (!filename.empty() || args[i].compare(0, 2, "--") == 0)
+            throw NoriException("Unexpected argument \"%s\"", args[i]);
+        filename = args[i];
+    }
+    if (filesystem::path(filename).extension() != "xml")
+        throw NoriException("Expected a scene file with an extension of type .xml");
+    return filename;
+}
+
+/// Render a scene without ever initializing nanogui
+static int renderHeadless(const std::string &filename, const RenderOptions &options) {
+    ImageBlock block(Vector2i(720, 720), nullptr);
+    RenderThread renderThread(block);
+
+    try {
+        if (!renderThread.renderScene(filename, options))
+            return 0; /* Not a scene (e.g. a test), which has already run */
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return 2;
+    }
+
+    renderThread.waitUntilDone();
+    return renderThread.hasFailed() ? 2 : 0;
+}
+
+/// Run a job that the render daemon received from \ref submitJob()
+static int runJob(const std::vector<std::string> &message) {
+    /* Relative paths of the job refer to the working directory of the client */
+    if (message.empty() || chdir(message[0].c_str()) != 0) {
+        cerr << "Error: invalid working directory of the job" << endl;
+        return 1;
+    }
+    *getFileResolver() = filesystem::resolver();
+
+    RenderOptions options;
+    std::string filename;
+    try {
+        filename = parseJob(std::vector<std::string>(message.begin() + 1, message.end()), options);
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    getAssetCache()->beginJob();
+    Timer timer;
+    int status = renderHeadless(filename, options);
+    cout << "Job finished in " << timer.elapsedString() << " ("
+         << getAssetCache()->getStatistics() << ")" << endl;
+    return status;
+}
+
+/**
+ * \brief Render jobs that are submitted to a Unix domain socket until a
+ * client sends "--shutdown"
+ *
+ * Meshes, textures, volume grids and BVHs stay in the asset cache between
+ * jobs. A job consists of the working directory of the client followed by
+ * the arguments of a headless rendering, separated by null characters. The
+ * response is the exit code of the job.
+ */
+static int runDaemon(const std::string &socketPath) {
+    /* Don't take over the socket of a running daemon */
+    try {
+        Socket::connectLocal(socketPath);
+        cerr << "Error: a daemon is already listening on \"" << socketPath << "\"" << endl;
+        return 1;
+    } catch (const std::exception &) { }
+    std::remove(socketPath.c_str());
+
+    Socket listener = Socket::listenLocal(socketPath);
+    getAssetCache()->setEnabled(true);
+    cout << "Waiting for jobs on \"" << socketPath << "\"" << endl;
+
+    bool running = true;
+    while (running) {
+        Socket client = listener.accept();
+        try {
+            std::string message;
+            if (!client.receive(message))
+                continue;
+            std::vector<std::string> job = tokenize(message, std::string(1, '\0'), true);
+
+            int status = 0;
+            if (job.size() == 2 && job[1] == "--shutdown")
+                running = false;
+            else
+                status = runJob(job);
+            client.send(tfm::format("%i", status));
+        } catch (const std::exception &e) {
+            cerr << "Warning: lost the connection to a client (" << e.what() << ")" << endl;
+        }
+    }
+
+    listener.close();
+    std::remove(socketPath.c_str());
+    return 0;
+}
+
+/// Submit a job ("scene.xml [options]" or "--shutdown") to a render daemon
+static int submitJob(const std::string &socketPath, const std::vector<std::string> &args) {
+    try {
+        /* Report invalid arguments right away */
+        if (args.size() != 1 || args[0] != "--shutdown") {
+            RenderOptions options;
+            parseJob(args, options);
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+
+    try {
+        std::string message = filesystem::path::getcwd().str();
+        for (const std::string &arg : args)
+            message += std::string(1, '\0') + arg;
+
+        Socket socket = Socket::connectLocal(socketPath);
+        socket.send(message);
+        std::string response;
+        if (!socket.receive(response))
+            throw NoriException("The daemon closed the connection");
+
+        int status = toInt(response);
+        if (status != 0)
+            cerr << "Error: the job failed (see the output of the daemon)" << endl;
+        return status;
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return 2;
+    }
+}
 
 int main(int argc, char **argv) {
-    using namespace nori;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string filename;
+    bool headless = false;
+    RenderOptions options;
+    std::string coordinator, daemonSocket;
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string &arg = args[i];
+            bool hasValue = i + 1 < args.size();
+
+            if (arg == "--render") {
+                headless = true;
+            } else if (arg == "--worker" && hasValue) {
+                coordinator = args[++i];
+            } else if (arg == "--daemon" && hasValue) {
+                daemonSocket = args[++i];
+            } else if (arg == "--submit" && hasValue) {
+                /* All remaining arguments belong to the job */
+                return submitJob(args[i + 1], std::vector<std::string>(args.begin() + i + 2, args.end()));
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (parseRenderOption(args, i, options)) {
+                /* Already handled */
+            } else if (filename.empty() && arg.compare(0, 2, "--") != 0) {
+                filename = arg;
+            } else {
+                cerr << "Error: unexpected argument \"" << arg << "\"" << endl;
+                printUsage();
+                return 1;
+            }
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+
+    int threadCount = options.threadCount > 0 ? options.threadCount : tbb::task_scheduler_init::automatic;
+
+    if (!daemonSocket.empty()) {
+        tbb::task_scheduler_init init(threadCount);
+        try {
+            return runDaemon(daemonSocket);
+        } catch (const std::exception &e) {
+            cerr << "Fatal error: " << e.what() << endl;
+            return 2;
+        }
+    }
+
+    if (!coordinator.empty()) {
+        tbb::task_scheduler_init init(threadCount);
+        try {
+            renderWorker(coordinator, options.threadCount > 0 ? options.threadCount
+                                      : tbb::task_scheduler_init::default_num_threads());
+        } catch (const std::exception &e) {
+            cerr << "Fatal error: " << e.what() << endl;
+            return 2;
+        }
+        return 0;
+    }
+
+    if (headless && filesystem::path(filename).extension() != "xml") {
+        cerr << "Error: --render expects a scene file with an extension of type .xml" << endl;
+        printUsage();
+        return 1;
+    }
+
+    tbb::task_scheduler_init init(threadCount);
 
     try {
+        if (headless)
+            return renderHeadless(filename, options);
+
         nanogui::init();
 
         // Open the UI with a dummy image
@@ -31,8 +425,7 @@ int main(int argc, char **argv) {
         NoriScreen *screen = new NoriScreen(block);
 
         // if file is passed as argument, handle it
-        if (argc == 2) {
-            std::string filename = argv[1];
+        if (!filename.empty()) {
             filesystem::path path(filename);
 
             if (path.extension() == "xml") {
@@ -0,0 +1,230 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/bitmap.h>
+#include <filesystem/path.h>
+#include <memory>
+#include <set>
+
+/*
+ * Combines independent renderings of the same scene (e.g. with different
+ * --seed values) into one image with the combined number of samples.
+ *
+ * Every pixel of input i with n_i samples, mean m_i and variance of the
+ * mean v_i (from "_variance.exr") is turned back into the sums of its
+ * samples and their squares:
+ *
+ *     s_i = n_i * m_i,    ss_i = v_i * n_i * (n_i - 1) + n_i * m_i^2
+ *
+ * The merged pixel then has N = sum n_i samples, the mean S/N and the
+ * variance of the mean (SS - S^2/N) / (N * (N - 1)), exactly like a single
+ * rendering with all samples.
+ */
+
+using namespace nori;
+
+typedef Eigen::Array<uint32_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> SampleCounts;
+
+/// Strip the ".exr" extension of a filename
+static std::string baseName(const std::string &filename) {
+    size_t lastdot = filename.find_last_of(".");
+    return lastdot != std::string::npos ? filename.substr(0, lastdot) : filename;
+}
+
+/// Return the value of a metadata entry, or an empty string
+static std::string lookup(const Bitmap::Metadata &metadata, const std::string &key) {
+    auto it = metadata.find(key);
+    return it != metadata.end() ? it->second : std::string();
+}
+
+/// Determine the per-pixel sample counts of an image from the metadata written by nori
+static SampleCounts sampleCounts(const Bitmap::Metadata &metadata, const Vector2i &size,
+                                 const std::string &filename, int &blockSize) {
+    SampleCounts counts(size.y(), size.x());
+
+    std::string blockCounts = lookup(metadata, "blockSampleCounts");
+    if (!blockCounts.empty()) {
+        blockSize = toInt(lookup(metadata, "blockSize"));
+        if (blockSize <= 0)
+            throw NoriException("\"%s\" has an invalid block size!", filename);
+        Vector2i numBlocks((size.x() + blockSize - 1) / blockSize, (size.y() + blockSize - 1) / blockSize);
+        std::vector<std::string> tokens = tokenize(blockCounts, " ");
+        if (tokens.size() != (size_t) numBlocks.prod())
+            throw NoriException("\"%s\" has %i block sample counts, expected %i!",
+                                filename, tokens.size(), numBlocks.prod());
+
+        for (int y = 0; y < size.y(); ++y)
+            for (int x = 0; x < size.x(); ++x)
+                counts(y, x) = toUInt(tokens[(y / blockSize) * numBlocks.x() + x / blockSize]);
+        return counts;
+    }
+
+    /* Files of older versions only have the sample count range */
+    std::string sppMin = lookup(metadata, "sppMin");
+    if (sppMin.empty() || sppMin != lookup(metadata, "sppMax"))
+        throw NoriException("\"%s\" contains no per-pixel sample counts!", filename);
+    blockSize = 0;
+    counts.setConstant(toUInt(sppMin));
+    return counts;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        cerr << "Syntax: nori-merge <output.exr> <input1.exr> <input2.exr> [...]" << endl
+             << endl
+             << "Combines renderings of the same scene with different seeds (nori --seed)." << endl
+             << "The \"_variance.exr\" files of the inputs are merged as well if all of them exist." << endl;
+        return 1;
+    }
+
+    try {
+        std::string outputName = argv[1];
+        if (filesystem::path(outputName).extension() != "exr")
+            throw NoriException("The output \"%s\" must be an .exr file!", outputName);
+
+        std::vector<std::string> inputs(argv + 2, argv + argc);
+        bool mergeVariance = true;
+        for (const std::string &input : inputs) {
+            if (!filesystem::path(baseName(input) + "_variance.exr").exists()) {
+                cerr << "Warning: \"" << input << "\" has no variance file, only the image is merged" << endl;
+                mergeVariance = false;
+            }
+        }
+
+        Vector2i size(0, 0), displaySize(0, 0);
+        Point2i offset(0, 0); // of the data window (for crop windows)
+        std::vector<uint64_t> totalCounts;
+        std::vector<Eigen::Array3d> sum, sumSquared;
+        SampleCounts blockCounts; // per-block counts if all inputs use the same blocks
+        int commonBlockSize = -1;
+        std::set<std::string> seeds;
+
+        for (const std::string &input : inputs) {
+            Bitmap::Metadata metadata;
+            Point2i imageOffset;
+            Vector2i imageDisplaySize;
+            Bitmap image(input, &metadata, &imageOffset, &imageDisplaySize);
+            Vector2i imageSize((int) image.cols(), (int) image.rows());
+
+            if (size == Vector2i(0, 0)) {
+                size = imageSize;
+                offset = imageOffset;
+                displaySize = imageDisplaySize;
+                totalCounts.assign((size_t) size.prod(), 0);
+                sum.assign((size_t) size.prod(), Eigen::Array3d::Zero());
+                sumSquared.assign((size_t) size.prod(), Eigen::Array3d::Zero());
+            } else if (imageSize != size) {
+                throw NoriException("\"%s\" has a resolution of %ix%i, expected %ix%i!",
+                                    input, imageSize.x(), imageSize.y(), size.x(), size.y());
+            } else if (imageOffset != offset || imageDisplaySize != displaySize) {
+                throw NoriException("\"%s\" covers a different crop window of the image!", input);
+            }
+
+            std::string seed = lookup(metadata, "seed");
+            if (!seed.empty() && !seeds.insert(seed).second)
+                cerr << "Warning: \"" << input << "\" has the same seed (" << seed << ") as another input, "
+                     << "the merged result is correlated" << endl;
+
+            int blockSize;
+            SampleCounts counts = sampleCounts(metadata, size, input, blockSize);
+            if (commonBlockSize == -1)
+                commonBlockSize = blockSize;
+            else if (commonBlockSize != blockSize)
+                commonBlockSize = 0;
+
+            std::unique_ptr<Bitmap> variance;
+            if (mergeVariance) {
+                variance.reset(new Bitmap(baseName(input) + "_variance.exr"));
+                if (variance->cols() != size.x() || variance->rows() != size.y())
+                    throw NoriException("The variance file of \"%s\" has a different resolution!", input);
+            }
+
+            for (int y = 0; y < size.y(); ++y) {
+                for (int x = 0; x < size.x(); ++x) {
+                    size_t index = (size_t) y * size.x() + x;
+                    double n = counts(y, x);
+                    Eigen::Array3d mean = image(y, x).cast<double>();
+
+                    totalCounts[index] += counts(y, x);
+                    sum[index] += n * mean;
+                    sumSquared[index] += n * mean * mean;
+                    if (variance && n > 1)
+                        sumSquared[index] += (*variance)(y, x).cast<double>() * n * (n - 1);
+                }
+            }
+
+            if (commonBlockSize > 0) {
+                /* Every pixel of a block has the block's count, so sample the top left corners */
+                Vector2i numBlocks((size.x() + commonBlockSize - 1) / commonBlockSize,
+                                   (size.y() + commonBlockSize - 1) / commonBlockSize);
+                if (blockCounts.size() == 0)
+                    blockCounts.setZero(numBlocks.y(), numBlocks.x());
+                for (int y = 0; y < numBlocks.y(); ++y)
+                    for (int x = 0; x < numBlocks.x(); ++x)
+                        blockCounts(y, x) += counts(y * commonBlockSize, x * commonBlockSize);
+            }
+        }
+
+        Bitmap result(size), resultVariance(size);
+        uint64_t pixelSamples = 0;
+        uint64_t minSamples = std::numeric_limits<uint64_t>::max(), maxSamples = 0;
+        for (int y = 0; y < size.y(); ++y) {
+            for (int x = 0; x < size.x(); ++x) {
+                size_t index = (size_t) y * size.x() + x;
+                double n = (double) totalCounts[index];
+                pixelSamples += totalCounts[index];
+                minSamples = std::min(minSamples, totalCounts[index]);
+                maxSamples = std::max(maxSamples, totalCounts[index]);
+
+                if (n == 0) {
+                    result(y, x) = resultVariance(y, x) = Color3f(0.0f);
+                    continue;
+                }
+                result(y, x) = (sum[index] / n).cast<float>();
+                if (n < 2)
+                    resultVariance(y, x) = Color3f(0.0f);
+                else
+                    resultVariance(y, x) = ((sumSquared[index] - sum[index] * sum[index] / n)
+                                            / (n * (n - 1))).max(0.0).cast<float>();
+            }
+        }
+
+        Bitmap::Metadata metadata;
+        metadata["spp"] = tfm::format("%.6g", pixelSamples / (double) size.prod());
+        metadata["sppMin"] = tfm::format("%i", minSamples);
+        metadata["sppMax"] = tfm::format("%i", maxSamples);
+        if (commonBlockSize > 0) {
+            std::ostringstream counts;
+            for (int i = 0; i < blockCounts.size(); ++i)
+                counts << (i > 0 ? " " : "") << blockCounts(i);
+            metadata["blockSize"] = tfm::format("%i", commonBlockSize);
+            metadata["blockSampleCounts"] = counts.str();
+        }
+
+        cout << tfm::format("Merged %i images with %.1f samples per pixel on average (min: %i, max: %i)",
+                            inputs.size(), pixelSamples / (double) size.prod(), minSamples, maxSamples) << endl;
+
+        result.save(outputName, metadata, offset, displaySize);
+        if (mergeVariance)
+            resultVariance.save(baseName(outputName) + "_variance.exr", metadata, offset, displaySize);
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
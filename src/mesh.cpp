@@ -26,7 +26,15 @@
 
 NORI_NAMESPACE_BEGIN
 
-Mesh::Mesh() { }
+Mesh::Mesh() : m_V(nullptr, 3, 0), m_N(nullptr, 3, 0), m_UV(nullptr, 2, 0), m_F(nullptr, 3, 0) { }
+
+void Mesh::setGeometry(const MatrixXf &V, const MatrixXf &N, const MatrixXf &UV, const MatrixXu &F) {
+    /* A map is pointed at other data by constructing it again */
+    new (&m_V) Eigen::Map<const MatrixXf>(V.data(), V.rows(), V.cols());
+    new (&m_N) Eigen::Map<const MatrixXf>(N.data(), N.rows(), N.cols());
+    new (&m_UV) Eigen::Map<const MatrixXf>(UV.data(), UV.rows(), UV.cols());
+    new (&m_F) Eigen::Map<const MatrixXu>(F.data(), F.rows(), F.cols());
+}
 
 void Mesh::activate() {
     Shape::activate();
@@ -0,0 +1,518 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/bitmap.h>
+#include <nori/block.h>
+#include <nori/bsdf.h>
+#include <nori/bvh.h>
+#include <nori/emitter.h>
+#include <nori/mesh.h>
+#include <nori/perlinnoise.h>
+#include <nori/photon.h>
+#include <nori/rfilter.h>
+#include <nori/warp.h>
+#include <filesystem/resolver.h>
+#include <pcg32.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+
+/*
+ * Microbenchmarks of the kernels that dominate the render time. Every
+ * kernel runs over a fixed array of pre-generated inputs, so that only the
+ * kernel itself is timed. The number of iterations is calibrated until a
+ * repetition takes at least --min-time, and the time per operation is
+ * reported as the median (and spread) of several repetitions.
+ */
+
+using namespace nori;
+
+namespace {
+    /// Number of pre-generated inputs per kernel (a power of two)
+    const size_t InputCount = 4096;
+    const size_t InputMask = InputCount - 1;
+
+    /// Receives the results of the kernels, so that the compiler can't drop them
+    volatile float sink;
+
+    struct Kernel {
+        std::string name;
+        /// Run \c n operations and return a value that depends on all of their results
+        std::function<float(size_t n)> run;
+    };
+
+    struct Measurement {
+        size_t iterations = 0;
+        double median = 0, min = 0, mean = 0, stddev = 0; ///< Nanoseconds per operation
+    };
+
+    double runNanoseconds(const Kernel &kernel, size_t n) {
+        auto start = std::chrono::steady_clock::now();
+        sink = kernel.run(n);
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    Measurement measure(const Kernel &kernel, int repetitions, double minTime) {
+        Measurement result;
+
+        /* Calibrate the number of iterations (this also warms up the caches) */
+        size_t n = 16;
+        double time;
+        while ((time = runNanoseconds(kernel, n)) < minTime * 1e9 * 0.25 && n < ((size_t) 1 << 40))
+            n *= 2;
+        n = std::max((size_t) 1, (size_t) (n * (minTime * 1e9 / std::max(time, 1.0))));
+        result.iterations = n;
+
+        std::vector<double> times;
+        for (int i = 0; i < repetitions; ++i)
+            times.push_back(runNanoseconds(kernel, n) / n);
+
+        std::sort(times.begin(), times.end());
+        size_t mid = times.size() / 2;
+        result.median = times.size() % 2 ? times[mid] : 0.5 * (times[mid - 1] + times[mid]);
+        result.min = times.front();
+        for (double t : times)
+            result.mean += t;
+        result.mean /= times.size();
+        for (double t : times)
+            result.stddev += (t - result.mean) * (t - result.mean);
+        result.stddev = times.size() > 1 ? std::sqrt(result.stddev / (times.size() - 1)) : 0;
+        return result;
+    }
+
+    /// Kernel that applies \c func to an array of inputs and sums up the results
+    template <typename Input, typename Func>
+    Kernel makeKernel(const std::string &name, std::shared_ptr<std::vector<Input>> inputs, Func func) {
+        return Kernel { name, [inputs, func](size_t n) {
+            const std::vector<Input> &values = *inputs;
+            float sum = 0;
+            for (size_t i = 0; i < n; ++i)
+                sum += func(values[i & InputMask]);
+            return sum;
+        } };
+    }
+
+    std::shared_ptr<std::vector<Point2f>> randomSamples(pcg32 &rng) {
+        auto samples = std::make_shared<std::vector<Point2f>>(InputCount);
+        for (Point2f &sample : *samples)
+            sample = Point2f(rng.nextFloat(), rng.nextFloat());
+        return samples;
+    }
+
+    std::shared_ptr<std::vector<Vector3f>> randomDirections(pcg32 &rng) {
+        auto directions = std::make_shared<std::vector<Vector3f>>(InputCount);
+        for (Vector3f &direction : *directions)
+            direction = Warp::squareToUniformSphere(Point2f(rng.nextFloat(), rng.nextFloat()));
+        return directions;
+    }
+
+    /// Rays between random points of an enlarged bounding box
+    std::shared_ptr<std::vector<Ray3f>> randomRays(const BoundingBox3f &bbox, pcg32 &rng) {
+        auto rays = std::make_shared<std::vector<Ray3f>>(InputCount);
+        Vector3f extents = bbox.getExtents();
+        auto randomPoint = [&] {
+            return Point3f(bbox.min + extents.cwiseProduct(Vector3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat())
+                * 1.5f - Vector3f::Constant(0.25f)));
+        };
+        for (Ray3f &ray : *rays) {
+            Point3f o = randomPoint();
+            ray = Ray3f(o, (randomPoint() - o).normalized());
+        }
+        return rays;
+    }
+
+    /// Rays of a pinhole camera looking at the center of the bounding box, in scanline order (\c extent: size of the image plane at distance 1)
+    std::shared_ptr<std::vector<Ray3f>> coherentRays(const BoundingBox3f &bbox, float extent = 0.8f) {
+        auto rays = std::make_shared<std::vector<Ray3f>>();
+        const int resolution = 64; // InputCount = resolution^2
+        Point3f center = bbox.getCenter();
+        float radius = bbox.getExtents().norm() * 0.5f;
+        Point3f o = center + Vector3f(0.3f, 0.4f, 1.f).normalized() * radius * 2.5f;
+        Frame frame((center - o).normalized());
+        for (int y = 0; y < resolution; ++y) {
+            for (int x = 0; x < resolution; ++x) {
+                Vector3f d = frame.toWorld(Vector3f(((x + 0.5f) / resolution - 0.5f) * extent,
+                                                    ((y + 0.5f) / resolution - 0.5f) * extent, 1.f));
+                rays->push_back(Ray3f(o, d.normalized()));
+            }
+        }
+        return rays;
+    }
+
+    /// Owns the objects that the kernels operate on
+    struct Fixtures {
+        std::unique_ptr<BVH> bvh;
+        std::vector<const Mesh *> meshes;
+        std::unique_ptr<BSDF> disney;
+        std::unique_ptr<Emitter> environment;
+        std::unique_ptr<ReconstructionFilter> filter;
+        std::unique_ptr<ImageBlock> block;
+        std::unique_ptr<PointKDTree<Photon>> photons;
+    };
+
+    void addWarpKernels(std::vector<Kernel> &kernels, pcg32 &rng) {
+        auto samples = randomSamples(rng);
+        auto directions = randomDirections(rng);
+        auto points = std::make_shared<std::vector<Point2f>>(InputCount);
+        for (Point2f &p : *points)
+            p = Point2f(rng.nextFloat() * 2 - 1, rng.nextFloat() * 2 - 1);
+        const float alpha = 0.3f;
+
+        kernels.push_back(makeKernel("Warp::squareToUniformSquare", samples,
+            [](const Point2f &s) { return Warp::squareToUniformSquare(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformSquarePdf", points,
+            [](const Point2f &p) { return Warp::squareToUniformSquarePdf(p); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformDisk", samples,
+            [](const Point2f &s) { return Warp::squareToUniformDisk(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformDiskPdf", points,
+            [](const Point2f &p) { return Warp::squareToUniformDiskPdf(p); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformSphere", samples,
+            [](const Point2f &s) { return Warp::squareToUniformSphere(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformSpherePdf", directions,
+            [](const Vector3f &v) { return Warp::squareToUniformSpherePdf(v); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformSphereCap", samples,
+            [](const Point2f &s) { return Warp::squareToUniformSphereCap(s, 0.8f).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformSphereCapPdf", directions,
+            [](const Vector3f &v) { return Warp::squareToUniformSphereCapPdf(v, 0.8f); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformHemisphere", samples,
+            [](const Point2f &s) { return Warp::squareToUniformHemisphere(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformHemispherePdf", directions,
+            [](const Vector3f &v) { return Warp::squareToUniformHemispherePdf(v); }));
+        kernels.push_back(makeKernel("Warp::squareToCosineHemisphere", samples,
+            [](const Point2f &s) { return Warp::squareToCosineHemisphere(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToCosineHemispherePdf", directions,
+            [](const Vector3f &v) { return Warp::squareToCosineHemispherePdf(v); }));
+        kernels.push_back(makeKernel("Warp::squareToBeckmann", samples,
+            [alpha](const Point2f &s) { return Warp::squareToBeckmann(s, alpha).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToBeckmannPdf", directions,
+            [alpha](const Vector3f &v) { return Warp::squareToBeckmannPdf(v, alpha); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformTriangle", samples,
+            [](const Point2f &s) { return Warp::squareToUniformTriangle(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToUniformCylinder", samples,
+            [](const Point2f &s) { return Warp::squareToUniformCylinder(s).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToGTR1", samples,
+            [alpha](const Point2f &s) { return Warp::squareToGTR1(s, alpha).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToGTR1Pdf", directions,
+            [alpha](const Vector3f &v) { return Warp::squareToGTR1Pdf(v, alpha); }));
+        kernels.push_back(makeKernel("Warp::squareToGTR2", samples,
+            [alpha](const Point2f &s) { return Warp::squareToGTR2(s, alpha).x(); }));
+        kernels.push_back(makeKernel("Warp::squareToGTR2Pdf", directions,
+            [alpha](const Vector3f &v) { return Warp::squareToGTR2Pdf(v, alpha); }));
+    }
+
+    void addGeometryKernels(std::vector<Kernel> &kernels, Fixtures &fixtures,
+                            const std::vector<std::string> &meshNames, pcg32 &rng) {
+        fixtures.bvh.reset(new BVH());
+        for (const std::string &meshName : meshNames) {
+            /* Meshes are resolved relative to their directory, like those of a scene */
+            size_t slash = meshName.find_last_of("/\\");
+            if (slash != std::string::npos)
+                getFileResolver()->prepend(filesystem::path(meshName).parent_path());
+            PropertyList propList;
+            propList.setString("filename", slash != std::string::npos ? meshName.substr(slash + 1) : meshName);
+            Mesh *mesh = static_cast<Mesh *>(NoriObjectFactory::createInstance("obj", propList));
+            mesh->activate();
+            fixtures.bvh->addShape(mesh);
+            fixtures.meshes.push_back(mesh);
+        }
+        fixtures.bvh->build();
+
+        const BVH *bvh = fixtures.bvh.get();
+        BoundingBox3f bbox = bvh->getBoundingBox();
+        auto rays = randomRays(bbox, rng);
+
+        kernels.push_back(makeKernel("BVH::rayIntersect (random)", rays, [bvh](const Ray3f &ray) {
+            Intersection its;
+            return bvh->rayIntersect(ray, its) ? its.t : 0.f;
+        }));
+        kernels.push_back(makeKernel("BVH::rayIntersect (coherent)", coherentRays(bbox), [bvh](const Ray3f &ray) {
+            Intersection its;
+            return bvh->rayIntersect(ray, its) ? its.t : 0.f;
+        }));
+
+        /* The central 64x64 pixels of a 512x512 camera, whose rows are traced
+           one ray at a time or in packets (the time is per ray) */
+        auto tile = coherentRays(bbox, 0.1f);
+        kernels.push_back(makeKernel("BVH::rayIntersect (camera tile)", tile, [bvh](const Ray3f &ray) {
+            Intersection its;
+            return bvh->rayIntersect(ray, its) ? its.t : 0.f;
+        }));
+        kernels.push_back(Kernel { "BVH::rayIntersect (camera tile, packets)", [bvh, tile](size_t n) {
+            Intersection its[BVH::PacketSize];
+            bool hits[BVH::PacketSize];
+            float sum = 0;
+            for (size_t i = 0; i < n; i += BVH::PacketSize) {
+                uint32_t count = (uint32_t) std::min(n - i, (size_t) BVH::PacketSize);
+                bvh->rayIntersect(&(*tile)[i & InputMask], count, its, hits);
+                for (uint32_t k = 0; k < count; ++k)
+                    sum += hits[k] ? its[k].t : 0.f;
+            }
+            return sum;
+        } });
+        kernels.push_back(makeKernel("BVH::rayIntersect (camera tile, shadow)", tile, [bvh](const Ray3f &ray) {
+            Intersection its;
+            return bvh->rayIntersect(ray, its, true) ? 1.f : 0.f;
+        }));
+        kernels.push_back(Kernel { "BVH::rayIntersect (camera tile, shadow packets)", [bvh, tile](size_t n) {
+            bool occluded[BVH::PacketSize];
+            float sum = 0;
+            for (size_t i = 0; i < n; i += BVH::PacketSize) {
+                uint32_t count = (uint32_t) std::min(n - i, (size_t) BVH::PacketSize);
+                bvh->rayIntersect(&(*tile)[i & InputMask], count, nullptr, occluded, true);
+                for (uint32_t k = 0; k < count; ++k)
+                    sum += occluded[k] ? 1.f : 0.f;
+            }
+            return sum;
+        } });
+        kernels.push_back(makeKernel("BVH::rayIntersect (shadow)", rays, [bvh](const Ray3f &ray) {
+            Intersection its;
+            return bvh->rayIntersect(ray, its, true) ? 1.f : 0.f;
+        }));
+        kernels.push_back(makeKernel("BoundingBox::rayIntersect", rays, [bbox](const Ray3f &ray) {
+            float nearT, farT;
+            return bbox.rayIntersect(ray, nearT, farT) ? nearT : 0.f;
+        }));
+
+        /* Rays towards the centroids of random triangles, which mostly hit */
+        struct TriangleRay { const Mesh *mesh; uint32_t index; Ray3f ray; };
+        auto triangleRays = std::make_shared<std::vector<TriangleRay>>(InputCount);
+        for (size_t i = 0; i < InputCount; ++i) {
+            TriangleRay &tr = (*triangleRays)[i];
+            tr.mesh = fixtures.meshes[i % fixtures.meshes.size()];
+            tr.index = rng.nextUInt(tr.mesh->getPrimitiveCount());
+            Point3f o = (*rays)[i].o;
+            tr.ray = Ray3f(o, (tr.mesh->getCentroid(tr.index) - o).normalized());
+        }
+        kernels.push_back(makeKernel("Mesh::rayIntersect", triangleRays, [](const TriangleRay &tr) {
+            float u, v, t;
+            return tr.mesh->rayIntersect(tr.index, tr.ray, u, v, t) ? t : 0.f;
+        }));
+    }
+
+    void addShadingKernels(std::vector<Kernel> &kernels, Fixtures &fixtures, pcg32 &rng) {
+        PropertyList disneyProps;
+        disneyProps.setColor("albedo", Color3f(0.8f, 0.5f, 0.3f));
+        disneyProps.setFloat("metallic", 0.3f);
+        disneyProps.setFloat("roughness", 0.4f);
+        disneyProps.setFloat("specular", 0.5f);
+        disneyProps.setFloat("sheen", 0.2f);
+        disneyProps.setFloat("clearcoat", 0.3f);
+        fixtures.disney.reset(static_cast<BSDF *>(NoriObjectFactory::createInstance("disneyBSDF", disneyProps)));
+        fixtures.disney->activate();
+        const BSDF *disney = fixtures.disney.get();
+
+        /* Pairs of directions in the upper hemisphere */
+        auto records = std::make_shared<std::vector<BSDFQueryRecord>>();
+        for (size_t i = 0; i < InputCount; ++i) {
+            Vector3f wi = Warp::squareToCosineHemisphere(Point2f(rng.nextFloat(), rng.nextFloat()));
+            Vector3f wo = Warp::squareToCosineHemisphere(Point2f(rng.nextFloat(), rng.nextFloat()));
+            records->push_back(BSDFQueryRecord(wi, wo, ESolidAngle));
+        }
+        auto samples = randomSamples(rng);
+        auto sampleRecords = std::make_shared<std::vector<std::pair<BSDFQueryRecord, Point2f>>>();
+        for (size_t i = 0; i < InputCount; ++i)
+            sampleRecords->push_back(std::make_pair(BSDFQueryRecord((*records)[i].wi), (*samples)[i]));
+
+        kernels.push_back(makeKernel("DisneyBSDF::eval", records,
+            [disney](const BSDFQueryRecord &bRec) { return disney->eval(bRec).r(); }));
+        kernels.push_back(makeKernel("DisneyBSDF::sample", sampleRecords,
+            [disney](const std::pair<BSDFQueryRecord, Point2f> &input) {
+                BSDFQueryRecord bRec(input.first);
+                return disney->sample(bRec, input.second).r();
+            }));
+        kernels.push_back(makeKernel("DisneyBSDF::pdf", records,
+            [disney](const BSDFQueryRecord &bRec) { return disney->pdf(bRec); }));
+
+        /* Environment map with a bright spot, written to a temporary file. It is
+           square, since Environment::computeCDF() uses the row count for both CDFs */
+        Bitmap envmap(Vector2i(256, 256));
+        for (int y = 0; y < envmap.rows(); ++y) {
+            for (int x = 0; x < envmap.cols(); ++x) {
+                float dx = (x - 150) / 20.f, dy = (y - 80) / 20.f;
+                envmap(y, x) = Color3f(0.2f + 0.1f * y / envmap.rows()) + Color3f(50.f) * std::exp(-dx * dx - dy * dy);
+            }
+        }
+        std::string envmapName = "nori-microbench-envmap.exr";
+        envmap.save(envmapName);
+        PropertyList envProps;
+        envProps.setString("filename", envmapName);
+        fixtures.environment.reset(static_cast<Emitter *>(NoriObjectFactory::createInstance("environment", envProps)));
+        fixtures.environment->activate();
+        std::remove(envmapName.c_str());
+        const Emitter *environment = fixtures.environment.get();
+        kernels.push_back(makeKernel("Environment::sample", samples, [environment](const Point2f &s) {
+            EmitterQueryRecord lRec(Point3f(0.f, 0.f, 0.f));
+            return environment->sample(lRec, s).r();
+        }));
+
+        auto points = std::make_shared<std::vector<Point3f>>(InputCount);
+        for (Point3f &p : *points)
+            p = Point3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat()) * 16.f;
+        kernels.push_back(makeKernel("PerlinNoise::get3DPerlinNoise", points,
+            [](const Point3f &p) { return PerlinNoise::get3DPerlinNoise(p); }));
+    }
+
+    void addFilmKernels(std::vector<Kernel> &kernels, Fixtures &fixtures, pcg32 &rng) {
+        fixtures.filter.reset(static_cast<ReconstructionFilter *>(
+            NoriObjectFactory::createInstance("gaussian", PropertyList())));
+        fixtures.filter->activate();
+        fixtures.block.reset(new ImageBlock(Vector2i(NORI_BLOCK_SIZE, NORI_BLOCK_SIZE), fixtures.filter.get()));
+        fixtures.block->clear();
+        ImageBlock *block = fixtures.block.get();
+
+        auto positions = std::make_shared<std::vector<Point2f>>(InputCount);
+        for (Point2f &p : *positions)
+            p = Point2f(rng.nextFloat(), rng.nextFloat()) * (float) NORI_BLOCK_SIZE;
+        kernels.push_back(makeKernel("ImageBlock::put", positions, [block](const Point2f &p) {
+            block->put(p, Color3f(0.5f));
+            return 0.f;
+        }));
+
+        /* Photons that are uniformly distributed in the unit cube, about 30 per query */
+        fixtures.photons.reset(new PointKDTree<Photon>());
+        for (int i = 0; i < 100000; ++i)
+            fixtures.photons->push_back(Photon(Point3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat()),
+                                               Vector3f(0.f, 0.f, 1.f), Color3f(1.f)));
+        fixtures.photons->build();
+        const PointKDTree<Photon> *photons = fixtures.photons.get();
+        auto queries = std::make_shared<std::vector<Point3f>>(InputCount);
+        for (Point3f &p : *queries)
+            p = Point3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+        auto results = std::make_shared<std::vector<uint32_t>>();
+        kernels.push_back(makeKernel("PointKDTree::search", queries, [photons, results](const Point3f &p) {
+            photons->search(p, 0.04f, *results);
+            return (float) results->size();
+        }));
+    }
+
+    void printUsage() {
+        cout << "Syntax: nori-microbench [options] [kernel name filters]" << endl
+             << endl
+             << "Reports the time per operation of the kernels whose name contains one of the" << endl
+             << "filters (default: all) as the median of several repetitions." << endl
+             << endl
+             << "Options:" << endl
+             << "   --mesh <file.obj>    Mesh of the BVH kernels, can be repeated" << endl
+             << "                        (default: scenes/pa1/camelhead.obj)" << endl
+             << "   --repetitions <n>    Number of timed repetitions (default: 15)" << endl
+             << "   --min-time <seconds> Minimal duration of a repetition (default: 0.05)" << endl
+             << "   --json <file.json>   Write the results as JSON" << endl
+             << "   --list               List the kernels" << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args(argv + 1, argv + argc), filters, meshNames;
+    int repetitions = 15;
+    double minTime = 0.05;
+    std::string jsonName;
+    bool list = false;
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string &arg = args[i];
+            bool hasValue = i + 1 < args.size();
+            if (arg == "--mesh" && hasValue) {
+                meshNames.push_back(args[++i]);
+            } else if (arg == "--repetitions" && hasValue) {
+                repetitions = toInt(args[++i]);
+                if (repetitions <= 0)
+                    throw NoriException("The number of repetitions must be positive!");
+            } else if (arg == "--min-time" && hasValue) {
+                minTime = toFloat(args[++i]);
+                if (!(minTime > 0))
+                    throw NoriException("The minimal time must be positive!");
+            } else if (arg == "--json" && hasValue) {
+                jsonName = args[++i];
+            } else if (arg == "--list") {
+                list = true;
+            } else if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if (arg.compare(0, 2, "--") != 0) {
+                filters.push_back(arg);
+            } else {
+                throw NoriException("Unknown option \"%s\"", arg);
+            }
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+    if (meshNames.empty())
+        meshNames.push_back("scenes/pa1/camelhead.obj");
+
+    std::vector<Kernel> kernels;
+    Fixtures fixtures;
+    pcg32 rng;
+    try {
+        addGeometryKernels(kernels, fixtures, meshNames, rng);
+        addWarpKernels(kernels, rng);
+        addShadingKernels(kernels, fixtures, rng);
+        addFilmKernels(kernels, fixtures, rng);
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return 2;
+    }
+
+    if (list) {
+        for (const Kernel &kernel : kernels)
+            cout << kernel.name << endl;
+        return 0;
+    }
+
+    std::vector<std::pair<const Kernel *, Measurement>> results;
+    cout << endl << tfm::format("%-36s %10s %10s %8s %12s", "kernel", "ns/op", "min", "stddev", "iterations") << endl;
+    for (const Kernel &kernel : kernels) {
+        bool selected = filters.empty();
+        for (const std::string &filter : filters)
+            selected |= kernel.name.find(filter) != std::string::npos;
+        if (!selected)
+            continue;
+
+        Measurement m = measure(kernel, repetitions, minTime);
+        results.push_back(std::make_pair(&kernel, m));
+        cout << tfm::format("%-36s %10.2f %10.2f %7.1f%% %12i", kernel.name, m.median, m.min,
+                            100 * m.stddev / m.mean, m.iterations) << endl;
+    }
+
+    if (!jsonName.empty()) {
+        std::ofstream file(jsonName);
+        file << "{" << endl
+             << "  \"repetitions\": " << repetitions << "," << endl
+             << "  \"kernels\": [" << endl;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Measurement &m = results[i].second;
+            file << tfm::format("    {\"name\": \"%s\", \"nsPerOp\": %.3f, \"min\": %.3f, \"mean\": %.3f, "
+                    "\"stddev\": %.3f, \"iterations\": %i}", results[i].first->name, m.median, m.min,
+                    m.mean, m.stddev, m.iterations) << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        file << "  ]" << endl << "}" << endl;
+        if (!file) {
+            cerr << "Error: unable to write \"" << jsonName << "\"" << endl;
+            return 2;
+        }
+        cout << "Wrote the results to \"" << jsonName << "\"" << endl;
+    }
+    return 0;
+}
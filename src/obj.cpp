@@ -18,6 +18,8 @@
 
 #include <nori/mesh.h>
 #include <nori/timer.h>
+#include <nori/cache.h>
+#include <nori/profiler.h>
 #include <filesystem/resolver.h>
 #include <unordered_map>
 #include <fstream>
@@ -30,20 +32,95 @@ NORI_NAMESPACE_BEGIN
 class WavefrontOBJ : public Mesh {
 public:
     WavefrontOBJ(const PropertyList &propList) {
-        typedef std::unordered_map<OBJVertex, uint32_t, OBJVertexHash> VertexMap;
-
         filesystem::path filename =
             getFileResolver()->resolve(propList.getString("filename"));
+        Transform trafo = propList.getTransform("toWorld", Transform());
+
+        /* With keyframes, the mesh is loaded in object space and transformed per frame */
+        m_animation = propList.getAnimatedTransform("toWorld");
+        if (m_animation.isAnimated())
+            trafo = Transform();
+
+        /* Meshes are cached by the content of the file and the transformation */
+        bool loaded = false;
+        m_data = getAssetCache()->get<MeshData>("mesh",
+            [&] {
+                const Eigen::Matrix4f &matrix = trafo.getMatrix();
+                return AssetCache::hash(matrix.data(), sizeof(float) * matrix.size(),
+                                        AssetCache::hashFile(filename.str()));
+            },
+            [&] { loaded = true; return load(filename, trafo); });
+        if (!loaded)
+            cout << "Reusing \"" << filename << "\" from the cache (V=" << m_data->V.cols()
+                 << ", F=" << m_data->F.cols() << ")" << endl;
+
+        /* The mesh reads the (cached) geometry in place, except that an
+           animated mesh transforms its own copy of the vertices and normals */
+        m_bbox = m_data->bbox;
+        m_name = filename.str();
+        if (m_animation.isAnimated()) {
+            m_frameV = m_data->V;
+            m_frameN = m_data->N;
+            setGeometry(m_frameV, m_frameN, m_data->UV, m_data->F);
+            applyTransform(m_animation.eval(0));
+        } else {
+            setGeometry(m_data->V, m_data->N, m_data->UV, m_data->F);
+        }
+    }
+
+    virtual bool setFrame(float frame) override {
+        if (!m_animation.isAnimated())
+            return false;
+        Transform trafo = m_animation.eval(frame);
+        if (trafo.getMatrix() == m_frameTransform.getMatrix())
+            return false;
+        applyTransform(trafo);
+
+        /* The triangle areas changed as well */
+        m_pdf.clear();
+        m_pdf.reserve(getPrimitiveCount());
+        for (uint32_t i = 0; i < getPrimitiveCount(); ++i)
+            m_pdf.append(surfaceArea(i));
+        m_pdf.normalize();
+        return true;
+    }
 
+protected:
+    /// Transform the object space vertices and normals of an animated mesh
+    void applyTransform(const Transform &trafo) {
+        m_frameTransform = trafo;
+        m_bbox.reset();
+        for (int i = 0; i < m_data->V.cols(); ++i) {
+            Point3f p = trafo * Point3f(m_data->V.col(i));
+            m_frameV.col(i) = p;
+            m_bbox.expandBy(p);
+        }
+        for (int i = 0; i < m_data->N.cols(); ++i)
+            m_frameN.col(i) = (trafo * Normal3f(m_data->N.col(i))).normalized();
+    }
+
+    /// Geometry of an OBJ file after applying the transformation
+    struct MeshData {
+        MatrixXf V, N, UV;
+        MatrixXu F;
+        BoundingBox3f bbox;
+    };
+
+    /// Parse an OBJ file
+    static std::shared_ptr<MeshData> load(const filesystem::path &filename, const Transform &trafo) {
+        typedef std::unordered_map<OBJVertex, uint32_t, OBJVertexHash> VertexMap;
+
+        ProfileZone zone("WavefrontOBJ::load", filename.str());
         std::ifstream is(filename.str());
         if (is.fail())
             throw NoriException("Unable to open OBJ file \"%s\"!", filename);
-        Transform trafo = propList.getTransform("toWorld", Transform());
 
         cout << "Loading \"" << filename << "\" .. ";
         cout.flush();
         Timer timer;
 
+        std::shared_ptr<MeshData> data(new MeshData());
+
         std::vector<Vector3f>   positions;
         std::vector<Vector2f>   texcoords;
         std::vector<Vector3f>   normals;
@@ -62,7 +139,7 @@ public:
                 Point3f p;
                 line >> p.x() >> p.y() >> p.z();
                 p = trafo * p;
-                m_bbox.expandBy(p);
+                data->bbox.expandBy(p);
                 positions.push_back(p);
             } else if (prefix == "vt") {
                 Point2f tc;
@@ -104,31 +181,31 @@ public:
             }
         }
 
-        m_F.resize(3, indices.size()/3);
-        memcpy(m_F.data(), indices.data(), sizeof(uint32_t)*indices.size());
+        data->F.resize(3, indices.size()/3);
+        memcpy(data->F.data(), indices.data(), sizeof(uint32_t)*indices.size());
 
-        m_V.resize(3, vertices.size());
+        data->V.resize(3, vertices.size());
         for (uint32_t i=0; i<vertices.size(); ++i)
-            m_V.col(i) = positions.at(vertices[i].p-1);
+            data->V.col(i) = positions.at(vertices[i].p-1);
 
         if (!normals.empty()) {
-            m_N.resize(3, vertices.size());
+            data->N.resize(3, vertices.size());
             for (uint32_t i=0; i<vertices.size(); ++i)
-                m_N.col(i) = normals.at(vertices[i].n-1);
+                data->N.col(i) = normals.at(vertices[i].n-1);
         }
 
         if (!texcoords.empty()) {
-            m_UV.resize(2, vertices.size());
+            data->UV.resize(2, vertices.size());
             for (uint32_t i=0; i<vertices.size(); ++i)
-                m_UV.col(i) = texcoords.at(vertices[i].uv-1);
+                data->UV.col(i) = texcoords.at(vertices[i].uv-1);
         }
 
-        m_name = filename.str();
-        cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
+        cout << "done. (V=" << data->V.cols() << ", F=" << data->F.cols() << ", took "
              << timer.elapsedString() << " and "
-             << memString(m_F.size() * sizeof(uint32_t) +
-                          sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()))
+             << memString(data->F.size() * sizeof(uint32_t) +
+                          sizeof(float) * (data->V.size() + data->N.size() + data->UV.size()))
              << ")" << endl;
+        return data;
     }
 
 protected:
@@ -169,6 +246,11 @@ protected:
             return hash;
         }
     };
+
+    AnimatedTransform m_animation;    ///< Keyframes of the object-to-world transformation
+    Transform m_frameTransform;       ///< Transformation of the current frame
+    std::shared_ptr<MeshData> m_data; ///< Geometry (shared with the asset cache), in object space if animated
+    MatrixXf m_frameV, m_frameN;      ///< Vertices and normals of the current frame of an animated mesh
 };
 
 NORI_REGISTER_CLASS(WavefrontOBJ, "obj");
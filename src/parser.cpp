@@ -18,6 +18,7 @@
 
 #include <nori/parser.h>
 #include <nori/proplist.h>
+#include <nori/profiler.h>
 #include <Eigen/Geometry>
 #include <pugixml.hpp>
 #include <fstream>
@@ -26,6 +27,8 @@
 NORI_NAMESPACE_BEGIN
 
 NoriObject *loadFromXML(const std::string &filename) {
+    ProfileZone zone("loadFromXML", filename);
+
     /* Load the XML file using 'pugi' (a tiny self-contained XML parser implemented in C++) */
     pugi::xml_document doc;
     pugi::xml_parse_result result = doc.load_file(filename.c_str());
@@ -269,8 +272,15 @@ NoriObject *loadFromXML(const std::string &filename) {
                         }
                         break;
                     case ETransform: {
-                            check_attributes(node, { "name" });
-                            list.setTransform(node.attribute("name").value(), transform.matrix());
+                            if (node.attribute("frame")) {
+                                /* Keyframe of an animated transform */
+                                check_attributes(node, { "name", "frame" });
+                                list.addKeyframe(node.attribute("name").value(),
+                                    toFloat(node.attribute("frame").value()), transform.matrix());
+                            } else {
+                                check_attributes(node, { "name" });
+                                list.setTransform(node.attribute("name").value(), transform.matrix());
+                            }
                         }
                         break;
                     case ETranslate: {
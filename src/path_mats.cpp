@@ -2,6 +2,7 @@
 #include <nori/scene.h>
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -12,18 +13,25 @@ public:
     }
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        Intersection its;
+        bool hit = scene->rayIntersect(ray, its);
+        return LiFromIntersection(scene, sampler, ray, hit ? &its : nullptr);
+    }
+
+    Color3f LiFromIntersection(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+            const Intersection *firstIts) const {
         Color3f Li{0.0f};
         Color3f t{1.0f};
 
         Ray3f recursiveRay = ray;
         Intersection xo;
+        if (firstIts)
+            xo = *firstIts;
         float successProbability;
+        NORI_STATS_ONLY(int bounces = 0);
         
-        while (true) {
-            if (!scene->rayIntersect(recursiveRay, xo)) {
-                break;
-            }
-
+        bool hit = firstIts != nullptr;
+        while (hit) {
             // Contribution from material sampling
             if (xo.mesh->isEmitter()) {
                 EmitterQueryRecord emitterRecord{recursiveRay.o, xo.p, xo.shFrame.n};
@@ -34,21 +42,27 @@ public:
             // Russian Roulette
             successProbability = std::min(t.maxCoeff(), 0.99f);
             if (sampler->next1D() > successProbability || successProbability == 0.0f) {
+                NORI_STATS_ADD(ERussianRoulette, 1);
                 break;
             }
 
             t /= successProbability;
+            NORI_STATS_ONLY(bounces++);
 
             BSDFQueryRecord bsdfRecord{xo.shFrame.toLocal(-recursiveRay.d)};
             bsdfRecord.uv = xo.uv;
             t *= xo.mesh->getBSDF()->sample(bsdfRecord, sampler->next2D());
 
             recursiveRay = Ray3f{xo.p, xo.shFrame.toWorld(bsdfRecord.wo)};
+            hit = scene->rayIntersect(recursiveRay, xo);
         }
 
+        NORI_STATS_PATH_LENGTH(bounces);
         return Li;
     }
 
+    bool acceptsIntersections() const { return true; }
+
     std::string toString() const {
         return "PathMatsIntegrator[]";
     }
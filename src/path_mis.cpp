@@ -2,6 +2,7 @@
 #include <nori/scene.h>
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -12,6 +13,13 @@ public:
     }
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        Intersection its;
+        bool hit = scene->rayIntersect(ray, its);
+        return LiFromIntersection(scene, sampler, ray, hit ? &its : nullptr);
+    }
+
+    Color3f LiFromIntersection(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+            const Intersection *firstIts) const {
         Color3f Li{0.0f};
         Color3f t{1.0f};
 
@@ -19,16 +27,16 @@ public:
 
         Ray3f recursiveRay = ray;
         Intersection xo;
+        if (firstIts)
+            xo = *firstIts;
         float successProbability;
+        NORI_STATS_ONLY(int bounces = 0);
 
         auto wMat = 1.0f;
         auto wEm = 0.0f;
         
-        while (true) {
-            if (!scene->rayIntersect(recursiveRay, xo)) {
-                break;
-            }
-
+        bool hit = firstIts != nullptr;
+        while (hit) {
             // Contribution from material sampling
             if (xo.mesh->isEmitter()) {
                 EmitterQueryRecord emitterRecord{recursiveRay.o, xo.p, xo.shFrame.n};
@@ -39,10 +47,12 @@ public:
             // Russian Roulette
             successProbability = std::min(t.maxCoeff(), 0.99f);
             if (sampler->next1D() > successProbability || successProbability == 0.0f) {
+                NORI_STATS_ADD(ERussianRoulette, 1);
                 break;
             }
 
             t /= successProbability;
+            NORI_STATS_ONLY(bounces++);
 
             // Contribution from emitter sampling
             auto randomEmitter = scene->getRandomEmitter(sampler->next1D());
@@ -92,11 +102,16 @@ public:
                 auto pdfSum = pdfEm + pdfMat;
                 wMat = (pdfSum > 0) ? pdfMat / pdfSum : 0.0f;
             }
+
+            hit = scene->rayIntersect(recursiveRay, xo);
         }
 
+        NORI_STATS_PATH_LENGTH(bounces);
         return Li;
     }
 
+    bool acceptsIntersections() const { return true; }
+
     std::string toString() const {
         return "PathMisIntegrator[]";
     }
@@ -38,9 +38,18 @@ public:
         m_outputSize.y() = propList.getInteger("height", 720);
         m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
 
+        /* Optional crop window in pixels. Default: the entire image */
+        if (propList.has("cropWidth") || propList.has("cropHeight"))
+            setCropWindow(Point2i(propList.getInteger("cropOffsetX", 0), propList.getInteger("cropOffsetY", 0)),
+                          Vector2i(propList.getInteger("cropWidth", m_outputSize.x()),
+                                   propList.getInteger("cropHeight", m_outputSize.y())));
+
         /* Specifies an optional camera-to-world transformation. Default: none */
         m_cameraToWorld = propList.getTransform("toWorld", Transform());
 
+        /* Optional keyframes of the camera-to-world transformation (sequence rendering) */
+        m_animation = propList.getAnimatedTransform("toWorld");
+
         /* Horizontal field of view in degrees */
         m_fov = propList.getFloat("fov", 30.0f);
 
@@ -61,13 +70,34 @@ public:
 
         m_motionblur = propList.getBoolean("motionblur", false);
         m_finalMotion = propList.getTransform("motion", Transform());
-        
+
+        /* An animated camera moves towards its pose in the next frame instead */
+        if (m_animation.isAnimated() && propList.has("motion"))
+            throw NoriException("Perspective: the \"motion\" transform cannot be combined "
+                                "with an animated \"toWorld\" transform!");
+
+        if (m_animation.isAnimated())
+            setFrame(0);
 
         m_rfilter = NULL;
     }
 
     
 
+    virtual void setFrame(float frame) override {
+        if (!m_animation.isAnimated())
+            return;
+        m_cameraToWorld = m_animation.eval(frame);
+        /* With motion blur, the shutter stays open until the next frame */
+        m_finalMotion = m_animation.eval(frame + 1);
+    }
+
+    virtual void setOutputSize(const Vector2i &size) override {
+        m_outputSize = size;
+        m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
+        activate();
+    }
+
     virtual void activate() override {
         float aspect = m_outputSize.x() / (float) m_outputSize.y();
 
@@ -243,6 +273,7 @@ private:
     float K2;
     bool m_motionblur;
     Transform m_finalMotion;
+    AnimatedTransform m_animation;
 };
 
 NORI_REGISTER_CLASS(PerspectiveCamera, "perspective");
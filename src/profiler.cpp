@@ -0,0 +1,147 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/profiler.h>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    struct Event {
+        const char *name;
+        std::string detail;
+        int64_t start, end;
+    };
+
+    /// Events of one thread. The mutex is only contended while writing the trace
+    struct ThreadEvents {
+        int id;
+        std::string name;
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    std::mutex profilerMutex;
+    std::vector<ThreadEvents *> profilerThreads; // never released, like the threads of TBB
+    std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+    ThreadEvents &localEvents() {
+        static thread_local ThreadEvents *events = nullptr;
+        if (!events) {
+            events = new ThreadEvents();
+            std::lock_guard<std::mutex> lock(profilerMutex);
+            events->id = (int) profilerThreads.size() + 1;
+            events->name = tfm::format("thread %i", events->id);
+            profilerThreads.push_back(events);
+        }
+        return *events;
+    }
+
+    /// Escape a string for JSON
+    std::string escape(const std::string &string) {
+        std::string result;
+        for (char c : string) {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            if ((unsigned char) c < 0x20)
+                result += tfm::format("\\u%04x", (int) c);
+            else
+                result += c;
+        }
+        return result;
+    }
+}
+
+std::atomic<bool> Profiler::m_active(false);
+
+void Profiler::begin() {
+    std::lock_guard<std::mutex> lock(profilerMutex);
+    for (ThreadEvents *thread : profilerThreads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        thread->events.clear();
+    }
+    profilerEpoch = std::chrono::steady_clock::now();
+    m_active = true;
+}
+
+void Profiler::end(const std::string &filename) {
+    stop();
+
+    std::ofstream file(filename);
+    file << "{\"traceEvents\": [" << endl;
+    bool first = true;
+    std::lock_guard<std::mutex> lock(profilerMutex);
+    for (ThreadEvents *thread : profilerThreads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        if (thread->events.empty())
+            continue;
+
+        file << (first ? "" : ",\n") << tfm::format("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                "\"tid\": %i, \"args\": {\"name\": \"%s\"}}", thread->id, escape(thread->name));
+        first = false;
+        for (const Event &event : thread->events) {
+            file << ",\n" << tfm::format("{\"name\": \"%s\", \"cat\": \"nori\", \"ph\": \"X\", \"pid\": 1, "
+                    "\"tid\": %i, \"ts\": %i, \"dur\": %i", event.name, thread->id, event.start, event.end - event.start);
+            if (!event.detail.empty())
+                file << ", \"args\": {\"detail\": \"" << escape(event.detail) << "\"}";
+            file << "}";
+        }
+    }
+    file << endl << "]}" << endl;
+
+    if (!file)
+        cerr << "Warning: unable to write the trace \"" << filename << "\"" << endl;
+    else
+        cout << "Wrote the timeline to \"" << filename << "\"" << endl;
+}
+
+void Profiler::stop() {
+    m_active = false;
+}
+
+std::map<std::string, int64_t> Profiler::getTotals() {
+    std::map<std::string, int64_t> totals;
+    std::lock_guard<std::mutex> lock(profilerMutex);
+    for (ThreadEvents *thread : profilerThreads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        for (const Event &event : thread->events)
+            totals[event.name] += event.end - event.start;
+    }
+    return totals;
+}
+
+void Profiler::setThreadName(const std::string &name) {
+    ThreadEvents &events = localEvents();
+    std::lock_guard<std::mutex> lock(events.mutex);
+    events.name = name;
+}
+
+int64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - profilerEpoch).count();
+}
+
+void Profiler::record(const char *name, const std::string &detail, int64_t start, int64_t end) {
+    ThreadEvents &events = localEvents();
+    std::lock_guard<std::mutex> lock(events.mutex);
+    events.events.push_back(Event { name, detail, start, end });
+}
+
+NORI_NAMESPACE_END
@@ -60,5 +60,14 @@ DEFINE_PROPERTY_ACCESSOR(Vector2f, Vector2, vector)
 DEFINE_PROPERTY_ACCESSOR(std::string, String, string)
 DEFINE_PROPERTY_ACCESSOR(Transform, Transform, transform)
 
+void PropertyList::addKeyframe(const std::string &name, float frame, const Transform &value) {
+    m_animatedTransforms[name].addKeyframe(frame, value);
+}
+
+AnimatedTransform PropertyList::getAnimatedTransform(const std::string &name) const {
+    auto it = m_animatedTransforms.find(name);
+    return it != m_animatedTransforms.end() ? it->second : AnimatedTransform();
+}
+
 NORI_NAMESPACE_END
 
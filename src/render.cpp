@@ -26,10 +26,23 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/socket.h>
+#include <nori/stats.h>
+#include <nori/profiler.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/task_arena.h>
 #include <filesystem/resolver.h>
-#include <tbb/concurrent_vector.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <chrono>
 
 
 NORI_NAMESPACE_BEGIN
@@ -39,6 +52,7 @@ RenderThread::RenderThread(ImageBlock & block) :
 {
     m_render_status = 0;
     m_progress = 1.f;
+    m_failed = false;
 }
 RenderThread::~RenderThread() {
     stopRendering();
@@ -62,6 +76,12 @@ void RenderThread::stopRendering() {
     }
 }
 
+void RenderThread::waitUntilDone() {
+    if (m_render_thread.joinable())
+        m_render_thread.join();
+    m_render_status = 0;
+}
+
 float RenderThread::getProgress() {
     if(isBusy()) {
         return m_progress;
@@ -69,7 +89,453 @@ float RenderThread::getProgress() {
     else return 1.f;
 }
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block, float contribution) {
+/// Per-thread scratch memory that is reused for all blocks rendered by a thread
+struct TileStorage {
+    std::unique_ptr<ImageBlock> sampleBlock; ///< Contents of the current sample
+    std::unique_ptr<ImageBlock> accumBlock;  ///< Samples accumulated during one task
+};
+
+/// Binary I/O of plain values in checkpoint files and messages to worker processes
+template <typename T> static void writeValue(std::ostream &stream, const T &value) {
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static void readValue(std::istream &stream, T &value) {
+    stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (!stream)
+        throw NoriException("Unexpected end of the data!");
+}
+
+template <typename T> static void writeVector(std::ostream &stream, const std::vector<T> &vector) {
+    for (const T &value : vector)
+        writeValue(stream, value);
+}
+
+template <typename T> static void readVector(std::istream &stream, std::vector<T> &vector) {
+    for (T &value : vector)
+        readValue(stream, value);
+}
+
+/**
+ * \brief Progress of a rendering, i.e. everything that is needed to resume it
+ *
+ * Blocks are identified by the ID that the block generator assigns to them.
+ * Together with the film, the state is written to checkpoint files at the end
+ * of a pass, where it is identical to that of an uninterrupted rendering.
+ */
+struct RenderState {
+    std::vector<std::unique_ptr<Sampler>> samplers; ///< Sample generator of every started block
+    std::vector<uint32_t> blockSamples;  ///< Samples rendered so far
+    std::vector<uint8_t> blockConverged; ///< Blocks that adaptive sampling considers done
+    std::vector<Point2i> blockOffsets;
+    std::vector<Vector2i> blockSizes;
+    double previousTime = 0;             ///< Milliseconds spent rendering before resuming
+
+    /**
+     * Settings that determine the sequence of passes; a checkpoint can only
+     * be resumed by a rendering with exactly the same values
+     */
+    std::vector<uint32_t> layout;
+
+    RenderState(int numBlocks, const std::vector<uint32_t> &layout)
+        : samplers(numBlocks), blockSamples(numBlocks, 0), blockConverged(numBlocks, 0),
+          blockOffsets(numBlocks), blockSizes(numBlocks), layout(layout) { }
+
+    /// Write a checkpoint holding the state and the contents of the film
+    void save(std::ostream &stream, const ImageBlock &film, double renderTime) const {
+        stream.write(magic, sizeof(magic));
+        writeValue(stream, (uint32_t) layout.size());
+        writeVector(stream, layout);
+        writeValue(stream, renderTime);
+        writeVector(stream, blockSamples);
+        writeVector(stream, blockConverged);
+        writeVector(stream, blockOffsets);
+        writeVector(stream, blockSizes);
+        for (auto const &sampler : samplers) {
+            writeValue(stream, (uint8_t) (sampler ? 1 : 0));
+            if (sampler)
+                sampler->saveState(stream);
+        }
+        film.saveState(stream);
+    }
+
+    /// Restore a checkpoint written by \ref save()
+    void load(std::istream &stream, ImageBlock &film, const Sampler *sampler) {
+        char header[sizeof(magic)];
+        uint32_t layoutSize;
+        stream.read(header, sizeof(header));
+        if (!stream || std::string(header, sizeof(header)) != std::string(magic, sizeof(magic)))
+            throw NoriException("This is not a Nori checkpoint file!");
+        readValue(stream, layoutSize);
+        std::vector<uint32_t> storedLayout(layoutSize);
+        readVector(stream, storedLayout);
+        if (storedLayout != layout)
+            throw NoriException("The checkpoint was written by a rendering with a different "
+                                "image size, sample count or sampling settings!");
+        readValue(stream, previousTime);
+        readVector(stream, blockSamples);
+        readVector(stream, blockConverged);
+        readVector(stream, blockOffsets);
+        readVector(stream, blockSizes);
+        for (auto &blockSampler : samplers) {
+            uint8_t started;
+            readValue(stream, started);
+            if (started) {
+                blockSampler = sampler->clone();
+                blockSampler->loadState(stream);
+            }
+        }
+        film.loadState(stream);
+    }
+
+    static constexpr char magic[8] = { 'N', 'O', 'R', 'I', 'C', 'K', 'P', '2' };
+};
+
+constexpr char RenderState::magic[8];
+
+/**
+ * \brief Description of a rendering that a coordinator sends to every worker
+ * process when it connects
+ *
+ * Afterwards, the coordinator sends one \ref ERenderBlock message per block
+ * (block ID, first and last sample, sampler state if the block has been
+ * started) and the worker responds with the number of the next sample, the
+ * render time, the new sampler state and the accumulated block.
+ */
+struct RenderJob {
+    enum EMessage : uint8_t { ERenderBlock = 0, EQuit };
+
+    std::string sceneFilename;  ///< Absolute path of the scene
+    int sampleCount = 0;        ///< Sample count override (<= 0 keeps the sampler's setting)
+    uint32_t seed = 0;          ///< Seed offset of the sampler
+    uint32_t numSamples = 0;    ///< Sample count that determines the shutter times
+    bool unbounded = false;     ///< Is this a progressive rendering without a sample count?
+    int blockSize = NORI_BLOCK_SIZE;
+    bool trackMoments = false;
+    bool deterministic = false; ///< Replace the sampler by a counter-based one?
+    int width = 0, height = 0;  ///< Output size override (0: keep the camera's setting)
+    Point2i cropOffset = Point2i(0, 0);
+    Vector2i cropSize = Vector2i(0, 0);
+
+    std::string serialize() const {
+        std::ostringstream stream(std::ios::out | std::ios::binary);
+        writeValue(stream, (uint32_t) sceneFilename.size());
+        stream.write(sceneFilename.data(), sceneFilename.size());
+        writeValue(stream, sampleCount);
+        writeValue(stream, seed);
+        writeValue(stream, numSamples);
+        writeValue(stream, unbounded);
+        writeValue(stream, blockSize);
+        writeValue(stream, trackMoments);
+        writeValue(stream, deterministic);
+        writeValue(stream, width);
+        writeValue(stream, height);
+        writeValue(stream, cropOffset);
+        writeValue(stream, cropSize);
+        return stream.str();
+    }
+
+    void deserialize(const std::string &message) {
+        std::istringstream stream(message, std::ios::in | std::ios::binary);
+        uint32_t length;
+        readValue(stream, length);
+        sceneFilename.resize(length);
+        stream.read(&sceneFilename[0], length);
+        readValue(stream, sampleCount);
+        readValue(stream, seed);
+        readValue(stream, numSamples);
+        readValue(stream, unbounded);
+        readValue(stream, blockSize);
+        readValue(stream, trackMoments);
+        readValue(stream, deterministic);
+        readValue(stream, width);
+        readValue(stream, height);
+        readValue(stream, cropOffset);
+        readValue(stream, cropSize);
+    }
+};
+
+/**
+ * \brief Hands out the blocks of a pass to worker processes
+ *
+ * Workers can connect at any time, they join the current pass. Every
+ * connection is served by one thread for the entire rendering, which renders
+ * one block at a time with the scratch memory of the connection. The blocks
+ * of a connection that fails are handed out again, since the state of a block
+ * only changes once its result has arrived.
+ */
+class RenderCoordinator {
+public:
+    RenderCoordinator(int port, const RenderJob &job)
+            : m_listener(Socket::listen(port)), m_job(job.serialize()) {
+        cout << "waiting for workers on port " << port << " .. ";
+        cout.flush();
+        m_acceptThread = std::thread([this] { acceptWorkers(); });
+    }
+
+    ~RenderCoordinator() {
+        m_listener.shutdown();
+        m_acceptThread.join();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+            m_condition.notify_all();
+        }
+        for (auto &connection : m_connections)
+            connection->thread.join();
+
+        std::ostringstream quit(std::ios::out | std::ios::binary);
+        writeValue(quit, RenderJob::EQuit);
+        for (auto &connection : m_connections) {
+            try {
+                if (connection->alive)
+                    connection->socket.send(quit.str());
+            } catch (const std::exception &) { /* The worker is gone already */ }
+        }
+    }
+
+    /// Return the number of connected workers
+    int getConnectionCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return liveConnections();
+    }
+
+    /**
+     * \brief Render the tasks of the current pass of \c generator
+     *
+     * For every block, \c render is called with the connection to a worker
+     * and the scratch memory of that connection. This returns once all blocks
+     * have been rendered or \c stop returns \c true, and waits for workers
+     * while none have connected yet.
+     *
+     * \return \c false if all workers have been lost, in which case the
+     *     blocks of the pass that haven't been rendered are stored in \c remaining
+     */
+    template <typename RenderFunc, typename StopFunc>
+    bool renderPass(BlockGenerator &generator, const RenderFunc &render, const StopFunc &stop,
+                    std::vector<uint32_t> &remaining) {
+        std::vector<uint32_t> retry; // blocks whose worker failed (guarded by m_mutex)
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work = [&](Connection &connection) {
+            std::vector<uint32_t> blocks; // blocks of the current task
+            size_t next = 0;
+            while (!stop()) {
+                if (next == blocks.size()) {
+                    blocks.clear();
+                    next = 0;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        if (!retry.empty()) {
+                            blocks.push_back(retry.back());
+                            retry.pop_back();
+                        }
+                    }
+                    const uint32_t *begin, *end;
+                    if (blocks.empty()) {
+                        if (!generator.next(begin, end))
+                            break;
+                        blocks.assign(begin, end);
+                    }
+                }
+
+                try {
+                    render(connection.socket, connection.storage, blocks[next]);
+                    ++next;
+                } catch (const std::exception &e) {
+                    cerr << "Warning: lost a worker (" << e.what() << "), "
+                         << "its blocks are handed out again" << endl;
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    connection.alive = false;
+                    retry.insert(retry.end(), blocks.begin() + next, blocks.end());
+                    return;
+                }
+            }
+        };
+
+        bool result = true;
+        while (!stop()) {
+            if (liveConnections() == 0) {
+                if (m_connections.empty()) {
+                    m_condition.wait_for(lock, std::chrono::milliseconds(100));
+                    continue;
+                }
+
+                /* All workers are gone: hand the rest of the pass back to the caller */
+                remaining.swap(retry);
+                const uint32_t *begin, *end;
+                while (generator.next(begin, end))
+                    remaining.insert(remaining.end(), begin, end);
+                result = false;
+                break;
+            }
+
+            /* Every connection works on the pass until it runs out of blocks */
+            ++m_round;
+            m_condition.notify_all();
+            m_condition.wait(lock, [&] {
+                for (auto &connection : m_connections)
+                    if (connection->alive && connection->round != m_round)
+                        return false;
+                return true;
+            });
+
+            if (retry.empty())
+                break;
+        }
+        m_work = nullptr;
+        return result;
+    }
+
+private:
+    struct Connection {
+        Connection(Socket &&socket) : socket(std::move(socket)), alive(true) { }
+        Socket socket;
+        std::atomic<bool> alive;
+        uint64_t round = 0;  ///< Last round of work that the connection has finished
+        TileStorage storage; ///< Scratch memory of the blocks rendered by this connection
+        std::thread thread;
+    };
+
+    /// Return the number of connected workers (requires m_mutex)
+    int liveConnections() const {
+        int count = 0;
+        for (auto &connection : m_connections)
+            count += connection->alive ? 1 : 0;
+        return count;
+    }
+
+    /// Thread of a connection, which works on every round until the connection fails
+    void serve(Connection &connection) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_condition.wait(lock, [&] { return m_quit || (m_work && connection.round != m_round); });
+            if (m_quit)
+                return;
+            uint64_t round = m_round;
+            std::function<void(Connection &)> work = m_work;
+
+            lock.unlock();
+            work(connection);
+            lock.lock();
+
+            connection.round = round;
+            m_condition.notify_all();
+            if (!connection.alive)
+                return;
+        }
+    }
+
+    void acceptWorkers() {
+        while (true) {
+            try {
+                Socket socket = m_listener.accept();
+                if (!socket.isValid())
+                    return;
+                socket.send(m_job);
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_connections.emplace_back(new Connection(std::move(socket)));
+                Connection *connection = m_connections.back().get();
+                connection->thread = std::thread([this, connection] { serve(*connection); });
+                m_condition.notify_all();
+            } catch (const std::exception &e) {
+                cerr << "Warning: unable to accept a worker: " << e.what() << endl;
+            }
+        }
+    }
+
+    Socket m_listener;
+    std::string m_job;
+    std::thread m_acceptThread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+    std::function<void(Connection &)> m_work; ///< Work of the current pass (null between passes)
+    uint64_t m_round = 0;                     ///< Incremented whenever the connections are (re)started on a pass
+    bool m_quit = false;
+};
+
+/// Replace the sampler of a scene by a counter-based one with the same sample count and seed
+static void useDeterministicSampler(Scene *scene) {
+    const Sampler *sampler = scene->getSampler();
+    if (sampler->isCounterBased())
+        return;
+    PropertyList propList;
+    propList.setInteger("sampleCount", (int) sampler->getSampleCount());
+    propList.setInteger("seed", (int) sampler->getSeed());
+    Sampler *replacement = static_cast<Sampler *>(
+        NoriObjectFactory::createInstance("deterministic", propList));
+    replacement->activate();
+    scene->setSampler(replacement);
+}
+
+/// Scale the output size of the camera of a scene by \c scale
+static void scaleResolution(Scene *scene, float scale) {
+    if (scale == 1.f)
+        return;
+    if (!(scale > 0.f))
+        throw NoriException("Invalid resolution scale %f!", scale);
+    Camera *camera = scene->getCamera();
+    Vector2i size = camera->getOutputSize(), cropSize = camera->getCropSize();
+    Point2i cropOffset = camera->getCropOffset();
+    auto scaled = [scale](int value) { return (int) std::round(value * scale); };
+    camera->setOutputSize(Vector2i(std::max(scaled(size.x()), 1), std::max(scaled(size.y()), 1)));
+
+    /* Scale the crop window as well, keeping it within the image */
+    if (cropSize != size) {
+        Point2i offset = Point2i(scaled(cropOffset.x()), scaled(cropOffset.y())).cwiseMin(
+            camera->getOutputSize() - Vector2i::Ones());
+        Vector2i newSize = Vector2i(std::max(scaled(cropSize.x()), 1), std::max(scaled(cropSize.y()), 1)).cwiseMin(
+            camera->getOutputSize() - offset);
+        camera->setCropWindow(offset, newSize);
+    } else {
+        camera->setCropWindow(Point2i(0, 0), Vector2i(0, 0));
+    }
+}
+
+/// Time within the shutter interval (for motion blur) at which sample \c k is rendered
+static float shutterTime(uint32_t k, uint32_t sampleCount, bool unbounded) {
+    if (!unbounded)
+        return k / float(sampleCount);
+
+    /* Without a known sample count, use the van der Corput sequence, which
+       keeps every prefix of the samples well distributed over the interval */
+    k = (k << 16) | (k >> 16);
+    k = ((k & 0x00ff00ff) << 8) | ((k & 0xff00ff00) >> 8);
+    k = ((k & 0x0f0f0f0f) << 4) | ((k & 0xf0f0f0f0) >> 4);
+    k = ((k & 0x33333333) << 2) | ((k & 0xcccccccc) >> 2);
+    k = ((k & 0x55555555) << 1) | ((k & 0xaaaaaaaa) >> 1);
+    return std::min(k * 2.3283064365386963e-10f /* 2^-32 */, 1.0f - Epsilon);
+}
+
+/**
+ * \brief Per-pixel render cost of an image (see \ref RenderOptions::computeCost)
+ *
+ * Every block only adds to its own pixels, and a block is only rendered by
+ * one task at a time, so no synchronization is needed.
+ */
+struct CostImage {
+    Point2i offset;               ///< Offset of the crop window
+    Vector2i size;                ///< Size of the crop window
+    std::vector<float> time;      ///< Wall-clock time in microseconds, summed over the samples
+    std::vector<float> traversal; ///< BVH node visits, summed over the samples (requires NORI_STATS)
+
+    CostImage(const Point2i &offset, const Vector2i &size) : offset(offset), size(size),
+        time((size_t) size.prod(), 0.f), traversal((size_t) size.prod(), 0.f) { }
+
+    /// Return the cost as an image, with the same value in all channels
+    std::unique_ptr<Bitmap> toBitmap(const std::vector<float> &cost) const {
+        std::unique_ptr<Bitmap> bitmap(new Bitmap(size));
+        for (int y = 0; y < size.y(); ++y)
+            for (int x = 0; x < size.x(); ++x)
+                bitmap->coeffRef(y, x) = Color3f(cost[(size_t) y * size.x() + x]);
+        return bitmap;
+    }
+};
+
+static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
+                        uint32_t sampleIndex, float contribution, CostImage *cost) {
     const Camera *camera = scene->getCamera();
     const Integrator *integrator = scene->getIntegrator();
 
@@ -79,9 +545,75 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
     /* Clear the block contents */
     block.clear();
 
+    /* Counter-based samplers also render the pixels of the border (within the image),
+       so that the block receives the samples of all pixels in the filter footprint of
+       its own pixels in the same order for any block size. The border isn't merged */
+    Point2i start(0, 0), end(size);
+    if (sampler->isCounterBased()) {
+        Vector2i border = Vector2i::Constant(block.getBorderSize());
+        start = (start - border).cwiseMax(-offset);
+        end = (end + border).cwiseMin(camera->getOutputSize() - offset);
+    }
+
+    /* Integrators that accept intersections receive the camera rays of runs of
+       neighboring pixels within a row traced together (except when the cost of
+       every pixel is measured on its own) */
+    if (!cost && integrator->acceptsIntersections()) {
+        for (int y=start.y(); y<end.y(); ++y) {
+            for (int x0=start.x(); x0<end.x(); x0 += (int) BVH::PacketSize) {
+                uint32_t count = (uint32_t) std::min(end.x() - x0, (int) BVH::PacketSize);
+                Point2f pixelSamples[BVH::PacketSize];
+                Ray3f rays[BVH::PacketSize];
+                Color3f values[BVH::PacketSize];
+                Intersection its[BVH::PacketSize];
+                bool hits[BVH::PacketSize];
+
+                /* Sample the rays from the camera */
+                for (uint32_t i = 0; i < count; ++i) {
+                    Point2i pixel(x0 + (int) i + offset.x(), y + offset.y());
+                    sampler->startPixelSample(pixel, sampleIndex);
+                    pixelSamples[i] = pixel.cast<float>() + sampler->next2D();
+                    Point2f apertureSample = sampler->next2D();
+                    values[i] = camera->sampleRay(rays[i], pixelSamples[i], apertureSample, contribution);
+                }
+
+                scene->rayIntersect(rays, count, its, hits);
+
+                /* Counter-based samplers continue with the dimensions after the
+                   camera sample (pixel and aperture), so that the image doesn't change */
+                auto startSample = [&](uint32_t i) {
+                    if (sampler->isCounterBased())
+                        sampler->startPixelSample(Point2i(x0 + (int) i + offset.x(), y + offset.y()), sampleIndex, 4);
+                };
+
+                /* Compute the incident radiance */
+                Color3f Li[BVH::PacketSize];
+                integrator->LiPacket(scene, sampler, rays, its, hits, count, startSample, Li);
+
+                /* Store in the image block */
+                for (uint32_t i = 0; i < count; ++i) {
+                    values[i] *= Li[i];
+                    block.put(pixelSamples[i], values[i]);
+                }
+            }
+        }
+        NORI_STATS_ADD(ECameraRays, (uint64_t) (end - start).prod());
+        return;
+    }
+
     /* For each pixel and pixel sample sample */
-    for (int y=0; y<size.y(); ++y) {
-        for (int x=0; x<size.x(); ++x) {
+    for (int y=start.y(); y<end.y(); ++y) {
+        for (int x=start.x(); x<end.x(); ++x) {
+            /* The cost of border pixels is left to the block that contains them */
+            bool measureCost = cost && x >= 0 && y >= 0 && x < size.x() && y < size.y();
+            std::chrono::steady_clock::time_point costStart;
+            NORI_STATS_ONLY(uint64_t nodeVisits = 0);
+            if (measureCost) {
+                costStart = std::chrono::steady_clock::now();
+                NORI_STATS_ONLY(nodeVisits = Statistics::local().counters[Statistics::EBVHNodeVisits]);
+            }
+
+            sampler->startPixelSample(Point2i(x + offset.x(), y + offset.y()), sampleIndex);
             Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
             Point2f apertureSample = sampler->next2D();
 
@@ -94,13 +626,69 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
 
             /* Store in the image block */
             block.put(pixelSample, value);
+
+            if (measureCost) {
+                size_t pixel = (size_t) (y + offset.y() - cost->offset.y()) * cost->size.x()
+                    + x + offset.x() - cost->offset.x();
+                cost->time[pixel] += std::chrono::duration<float, std::micro>(
+                    std::chrono::steady_clock::now() - costStart).count();
+                NORI_STATS_ONLY(cost->traversal[pixel] += (float)
+                    (Statistics::local().counters[Statistics::EBVHNodeVisits] - nodeVisits));
+            }
         }
     }
+    NORI_STATS_ADD(ECameraRays, (uint64_t) (end - start).prod());
+}
+
+/**
+ * \brief Render the samples <tt>[k0, k1)</tt> of a block and add them (and
+ * their contribution to the pixel moments) to \c accumBlock
+ *
+ * \c stop is queried after every sample to end the rendering early.
+ *
+ * \return The index of the next sample to render
+ */
+template <typename StopFunc> static uint32_t renderSamples(const Scene *scene, Sampler *sampler,
+        ImageBlock &block, ImageBlock &accumBlock, uint32_t k0, uint32_t k1,
+        uint32_t numSamples, bool unbounded, const StopFunc &stop, CostImage *cost = nullptr) {
+    accumBlock.setOffset(block.getOffset());
+    accumBlock.setSize(block.getSize());
+    accumBlock.clear();
+
+    uint32_t k = k0;
+    for (; k < k1 && !stop(); ++k) {
+        // Render all contained pixels
+        renderBlock(scene, sampler, block, k, shutterTime(k, numSamples, unbounded), cost);
+        // Add the sample (and its contribution to the pixel moments) to this task's block
+        accumBlock.accumulate(block);
+    }
+    return k;
 }
 
-void RenderThread::renderScene(const std::string & filename) {
-    // TODO (gimoro): Make this a CLI argument or allow option in scene xml file
-    bool computeVariance = true;
+bool RenderThread::renderScene(const std::string & filename, const RenderOptions & options) {
+    bool computeVariance = options.computeVariance;
+    /* Adaptive sampling and the target variance need the per-pixel moments
+       even if no variance image is written */
+    bool trackMoments = computeVariance || options.adaptive || options.targetVariance > 0;
+
+    if (options.isSequence() && options.listenPort > 0)
+        throw NoriException("Sequence rendering is not supported with worker processes!");
+    if (options.computeCost && options.listenPort > 0)
+        throw NoriException("The cost image is not supported with worker processes!");
+
+    /* Until the render thread takes the recording over, write it when
+       this function returns or throws (e.g. if the scene fails to load) */
+    struct TraceGuard {
+        std::string filename;
+        ~TraceGuard() {
+            if (!filename.empty())
+                Profiler::end(filename);
+        }
+    } traceGuard { options.traceName };
+    if (!options.traceName.empty()) {
+        Profiler::begin();
+        Profiler::setThreadName("main");
+    }
 
     filesystem::path path(filename);
 
@@ -115,150 +703,711 @@ void RenderThread::renderScene(const std::string & filename) {
     if (root->getClassType() == NoriObject::EScene) {
         m_scene = static_cast<Scene *>(root);
 
+        if (options.sampleCount > 0)
+            m_scene->getSampler()->setSampleCount((size_t) options.sampleCount);
+        if (options.seed >= 0)
+            m_scene->getSampler()->setSeed((uint32_t) options.seed);
+        if (options.deterministic)
+            useDeterministicSampler(m_scene);
+        scaleResolution(m_scene, options.resolutionScale);
+        if (options.cropSize != Vector2i::Zero())
+            m_scene->getCamera()->setCropWindow(options.cropOffset, options.cropSize);
+
         const Camera *camera_ = m_scene->getCamera();
-        m_scene->getIntegrator()->preprocess(m_scene);
+        if (options.isSequence())
+            m_scene->setFrame((float) options.firstFrame);
+        {
+            ProfileZone zone("Integrator::preprocess");
+            m_scene->getIntegrator()->preprocess(m_scene);
+        }
 
-        /* Allocate memory for the entire output image and clear it */
-        m_block.init(camera_->getOutputSize(), camera_->getReconstructionFilter());
+        /* Allocate memory for the output image (or its crop window) and clear it */
+        m_block.init(camera_->getCropSize(), camera_->getReconstructionFilter(), trackMoments);
+        m_block.setOffset(camera_->getCropOffset());
         m_block.clear();
 
         /* Determine the filename of the output bitmap */
-        std::string outputName = filename;
+        std::string outputName = options.outputName.empty() ? filename : options.outputName;
         size_t lastdot = outputName.find_last_of(".");
         if (lastdot != std::string::npos)
             outputName.erase(lastdot, std::string::npos);
 
-        std::string varianceOutputName = outputName + "_variance.exr";
-        outputName += ".exr";
+        /* Worker processes may run in a different directory */
+        std::string sceneFilename = path.make_absolute().str();
 
-        /* Do the following in parallel and asynchronously */
-        m_render_status = 1;
-        m_render_thread = std::thread([this, outputName, computeVariance, varianceOutputName] {
-            const Camera *camera = m_scene->getCamera();
-            Vector2i outputSize = camera->getOutputSize();
+        /* Render the current frame of the scene to the given files */
+        auto renderFrame = [this, computeVariance, trackMoments, sceneFilename](const RenderOptions &options,
+                const std::string &outputName, const std::string &varianceOutputName, const std::string &checkpointName) {
+            std::thread checkpointWriter, snapshotWriter;
+            std::atomic<bool> snapshotBusy(false);
+            try {
+                const Camera *camera = m_scene->getCamera();
+                Vector2i outputSize = camera->getOutputSize();
+                Point2i cropOffset = camera->getCropOffset();
+                Vector2i cropSize = camera->getCropSize();
 
-            /* Create a block generator (i.e. a work scheduler) */
-            BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+                /* Create a block generator (i.e. a work scheduler) for the crop window */
+                int blockSize = options.blockSize > 0 ? options.blockSize : NORI_BLOCK_SIZE;
+                BlockGenerator blockGenerator(cropOffset, cropSize, blockSize);
 
-            cout << "Rendering .. ";
-            cout.flush();
-            Timer timer;
+                cout << "Rendering .. ";
+                cout.flush();
+                Statistics::reset();
+                Timer timer;
 
-            auto numSamples = m_scene->getSampler()->getSampleCount();
-            auto numBlocks = blockGenerator.getBlockCount();
+                uint32_t numSamples = (uint32_t) m_scene->getSampler()->getSampleCount();
+                /* Progressive renderings continue until one of their limits is hit */
+                bool unbounded = options.isProgressive() && options.sampleCount <= 0;
+                if (unbounded)
+                    numSamples = std::numeric_limits<uint32_t>::max();
+                double timeBudget = options.timeBudget * 1000.0; // in milliseconds
+                std::atomic<bool> budgetExhausted(false);
+                bool targetReached = false;
+                uint32_t samplesPerTask = (uint32_t) std::max(options.samplesPerTask, 1);
+                auto numBlocks = blockGenerator.getBlockCount();
+                float totalWork = (float) numBlocks * numSamples;
+                std::atomic<uint64_t> workDone(0);
 
-            tbb::concurrent_vector< std::unique_ptr<Sampler> > samplers;
-            samplers.resize(numBlocks);
+                /* With adaptive sampling, every block first receives 'baseSamples' samples.
+                   Afterwards, only blocks whose relative error is still above the threshold
+                   are refined further, up to the sample count of the sampler */
+                uint32_t baseSamples = numSamples;
+                if (options.adaptive)
+                    baseSamples = std::min((uint32_t) std::max(options.adaptiveBaseSamples, 2), numSamples);
 
-            // Variance estimation using "Bessel's correction"
-            ImageBlock varianceBlock{camera->getOutputSize(), camera->getReconstructionFilter()};
-            Bitmap sumBitmap{camera->getOutputSize()};
-            Bitmap sumSquaredBitmap{camera->getOutputSize()};
+                /* Counter-based samplers render the borders of the blocks, which aren't merged */
+                bool counterBased = m_scene->getSampler()->isCounterBased();
 
-            for (uint32_t k = 0; k < numSamples ; ++k) {
-                m_progress = k/float(numSamples);
-                if(m_render_status == 2)
-                    break;
+                auto floatBits = [](float value) { uint32_t bits; memcpy(&bits, &value, sizeof(bits)); return bits; };
+                uint32_t layoutValues[] = {
+                    (uint32_t) outputSize.x(), (uint32_t) outputSize.y(), (uint32_t) numBlocks,
+                    (uint32_t) blockSize, numSamples, baseSamples, samplesPerTask, trackMoments ? 1u : 0u,
+                    floatBits(options.adaptive ? options.adaptiveThreshold : 0.f),
+                    floatBits(options.targetVariance), m_scene->getSampler()->getSeed(),
+                    counterBased ? 1u : 0u, (uint32_t) cropOffset.x(), (uint32_t) cropOffset.y(),
+                    (uint32_t) cropSize.x(), (uint32_t) cropSize.y()
+                };
+                RenderState state(numBlocks, std::vector<uint32_t>(std::begin(layoutValues), std::end(layoutValues)));
+                std::vector<uint32_t> passSamples(numBlocks, 0); // samples of every block in the current pass
+                std::unique_ptr<CostImage> costImage(options.computeCost ? new CostImage(cropOffset, cropSize) : nullptr);
 
-                tbb::blocked_range<int> range(0, numBlocks);
+                if (options.resume) {
+                    std::ifstream file(checkpointName, std::ios::binary);
+                    if (!file)
+                        throw NoriException("Unable to open the checkpoint \"%s\"!", checkpointName);
+                    {
+                        std::lock_guard<ImageBlock> lock(m_block);
+                        state.load(file, m_block, m_scene->getSampler());
+                    }
+                    for (uint32_t samples : state.blockSamples)
+                        workDone += samples;
+                    cout << "resuming from \"" << checkpointName << "\" after "
+                         << timeString(state.previousTime) << " .. ";
+                    cout.flush();
+                }
 
-                if (computeVariance) varianceBlock.clear();
+                /* Total rendering time, including that before resuming */
+                auto elapsed = [&]() { return state.previousTime + timer.elapsed(); };
+
+                /* Checkpoints are copied into memory at the end of a pass and written to
+                   disk by a background thread, so that rendering continues meanwhile */
+                Timer checkpointTimer;
+                auto writeCheckpoint = [&]() {
+                    std::ostringstream stream(std::ios::out | std::ios::binary);
+                    state.save(stream, m_block, elapsed());
+                    std::shared_ptr<std::string> data = std::make_shared<std::string>(stream.str());
+
+                    if (checkpointWriter.joinable())
+                        checkpointWriter.join();
+                    checkpointWriter = std::thread([data, checkpointName] {
+                        /* Replace the previous checkpoint only once the new one is complete */
+                        std::string tempName = checkpointName + ".tmp";
+                        std::ofstream file(tempName, std::ios::binary);
+                        file.write(data->data(), data->size());
+                        file.close();
+                        if (!file || std::rename(tempName.c_str(), checkpointName.c_str()) != 0)
+                            cerr << "Warning: unable to write the checkpoint \"" << checkpointName << "\"" << endl;
+                    });
+                    checkpointTimer.reset();
+                };
 
-                auto map = [&](const tbb::blocked_range<int> &range) {
-                    // Allocate memory for a small image block to be rendered by the current thread
-                    ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                                     camera->getReconstructionFilter());
+                /* Snapshots of the image are normalized under the lock of the film (which only
+                   takes a copy) and encoded by a background thread. A snapshot is skipped while
+                   the previous one is still being written, so rendering never waits for it */
+                Timer snapshotTimer;
+                int passCount = 0;
+                auto writeSnapshot = [&]() {
+                    if (snapshotBusy)
+                        return;
+                    uint64_t pixelSamples = 0;
+                    for (int i = 0; i < numBlocks; ++i)
+                        pixelSamples += (uint64_t) state.blockSamples[i] * state.blockSizes[i].prod();
 
-                    for (int i = range.begin(); i < range.end(); ++i) {
-                        // Request an image block from the block generator
-                        blockGenerator.next(block);
+                    Bitmap::Metadata metadata;
+                    metadata["spp"] = tfm::format("%.6g", pixelSamples / (double) cropSize.prod());
+                    metadata["renderTime"] = tfm::format("%.3f", elapsed() / 1000.0);
+                    metadata["seed"] = tfm::format("%i", m_scene->getSampler()->getSeed());
+                    metadata["snapshot"] = tfm::format("%i", passCount);
 
-                        // Get block id to continue using the same sampler
-                        auto blockId = block.getBlockId();
-                        if(k == 0) { // Initialize the sampler for the first sample
+                    m_block.lock();
+                    std::shared_ptr<Bitmap> bitmap(m_block.toBitmap());
+                    std::shared_ptr<Bitmap> varianceBitmap(computeVariance ? m_block.toVarianceBitmap() : nullptr);
+                    m_block.unlock();
+
+                    if (snapshotWriter.joinable())
+                        snapshotWriter.join();
+                    snapshotBusy = true;
+                    snapshotWriter = std::thread([&snapshotBusy, bitmap, varianceBitmap, metadata, cropOffset,
+                                                  outputSize, outputName, varianceOutputName] {
+                        /* Replace the previous snapshot only once the new one is complete */
+                        auto save = [&](Bitmap &bitmap, const std::string &filename) {
+                            std::string tempName = filename + ".tmp";
+                            try {
+                                bitmap.save(tempName, metadata, cropOffset, outputSize);
+                                if (std::rename(tempName.c_str(), filename.c_str()) != 0)
+                                    throw NoriException("Unable to rename \"%s\"", tempName);
+                            } catch (const std::exception &e) {
+                                cerr << "Warning: unable to write the snapshot \"" << filename << "\": " << e.what() << endl;
+                            }
+                        };
+                        save(*bitmap, outputName);
+                        if (varianceBitmap)
+                            save(*varianceBitmap, varianceOutputName);
+                        snapshotBusy = false;
+                    });
+                    snapshotTimer.reset();
+                };
+
+                /* Scratch blocks are allocated once per thread (or worker connection) and reused by all tasks */
+                auto initStorage = [&](TileStorage &storage) -> TileStorage & {
+                    if (!storage.sampleBlock) {
+                        storage.sampleBlock.reset(new ImageBlock(Vector2i(blockSize),
+                                                                 camera->getReconstructionFilter()));
+                        storage.accumBlock.reset(new ImageBlock(Vector2i(blockSize),
+                                                                camera->getReconstructionFilter(),
+                                                                trackMoments));
+                        storage.accumBlock->setDeferEdgeMoments(!counterBased);
+                    }
+                    return storage;
+                };
+                tbb::enumerable_thread_specific<TileStorage> tileStorage;
+                auto localStorage = [&]() -> TileStorage & { return initStorage(tileStorage.local()); };
+
+                /* Borders of the blocks rendered in the current pass. They are merged in a
+                   fixed order after the pass, so that the image doesn't depend on the schedule */
+                std::vector<BlockBorder> blockBorders(numBlocks);
+                std::vector<uint8_t> hasBorder(numBlocks, 0);
+                int threadCount = options.threadCount > 0 ? options.threadCount
+                    : tbb::task_scheduler_init::default_num_threads();
+                /* The blocks are rendered in an arena with this many threads. This also limits
+                   the jobs of the render daemon, whose scheduler is only initialized once */
+                tbb::task_arena arena(threadCount);
+
+                /* Stop all tasks like an interruption once the time budget is exhausted */
+                auto stop = [&]() {
+                    int busy = 1;
+                    if (timeBudget > 0 && elapsed() >= timeBudget
+                            && m_render_status.compare_exchange_strong(busy, 2))
+                        budgetExhausted = true;
+                    return m_render_status == 2;
+                };
+
+                /* Add the samples [k0, k) of a block that were accumulated in 'accumBlock' to the image */
+                auto finishBlock = [&](uint32_t blockId, const ImageBlock &accumBlock, uint32_t k0, uint32_t k, double time) {
+                    blockGenerator.addCost(blockId, k - k0, time);
+
+                    /* Distinct blocks don't overlap, so their merges only exclude readers such as the GUI */
+                    m_block.lockShared();
+                    m_block.putInterior(accumBlock);
+                    m_block.unlockShared();
+                    if (!counterBased) {
+                        accumBlock.getBorder(blockBorders[blockId]);
+                        hasBorder[blockId] = 1;
+                    }
+
+                    state.blockOffsets[blockId] = accumBlock.getOffset();
+                    state.blockSizes[blockId] = accumBlock.getSize();
+                    state.blockSamples[blockId] = k;
+                    workDone += k - k0;
+                    float progress = workDone / totalWork;
+                    if (timeBudget > 0)
+                        progress = std::max(progress, (float) (elapsed() / timeBudget));
+                    m_progress = std::min(progress, 1.f);
+                };
+
+                /* With a coordinator, the blocks are rendered by worker processes that
+                   receive (and return) the sampler state along with every block */
+                std::unique_ptr<RenderCoordinator> coordinator;
+                if (options.listenPort > 0) {
+                    RenderJob job;
+                    job.sceneFilename = sceneFilename;
+                    job.sampleCount = options.sampleCount;
+                    job.seed = m_scene->getSampler()->getSeed();
+                    job.numSamples = numSamples;
+                    job.unbounded = unbounded;
+                    job.blockSize = blockSize;
+                    job.trackMoments = trackMoments;
+                    job.deterministic = options.deterministic;
+                    job.width = outputSize.x();
+                    job.height = outputSize.y();
+                    job.cropOffset = cropOffset;
+                    job.cropSize = cropSize;
+                    coordinator.reset(new RenderCoordinator(options.listenPort, job));
+                }
+
+                auto renderRemote = [&](Socket &socket, TileStorage &storage, uint32_t blockId) {
+                    ProfileZone zone("remote block", Profiler::isActive() ? tfm::format("block %i", blockId) : "");
+                    ImageBlock &accumBlock = *initStorage(storage).accumBlock;
+                    uint32_t k0 = state.blockSamples[blockId];
+
+                    std::ostringstream request(std::ios::out | std::ios::binary);
+                    writeValue(request, RenderJob::ERenderBlock);
+                    writeValue(request, blockId);
+                    writeValue(request, k0);
+                    writeValue(request, k0 + passSamples[blockId]);
+                    writeValue(request, (uint8_t) (state.samplers[blockId] ? 1 : 0));
+                    if (state.samplers[blockId])
+                        state.samplers[blockId]->saveState(request);
+                    socket.send(request.str());
+
+                    std::string message;
+                    if (!socket.receive(message))
+                        throw NoriException("The worker closed the connection");
+                    std::istringstream response(message, std::ios::in | std::ios::binary);
+                    uint32_t k;
+                    double time;
+                    readValue(response, k);
+                    readValue(response, time);
+                    std::unique_ptr<Sampler> sampler(m_scene->getSampler()->clone());
+                    sampler->loadState(response);
+                    blockGenerator.getBlock(blockId, accumBlock);
+                    accumBlock.loadState(response);
+
+                    state.samplers[blockId] = std::move(sampler);
+                    finishBlock(blockId, accumBlock, k0, k, time);
+                };
+
+                /* Every block receives a batch of up to 'samplesPerTask' samples per pass,
+                   so there is only one barrier (and merge) per pass */
+                while (m_render_status != 2) {
+                    if (options.targetVariance > 0) {
+                        float variance = m_block.getRelativeVariance(m_block.getOffset(), m_block.getSize());
+                        if (variance <= options.targetVariance) {
+                            targetReached = true;
+                            break;
+                        }
+                        m_progress = std::max((float) m_progress, options.targetVariance / variance);
+                    }
+
+                    /* Decide which blocks receive further samples in this pass */
+                    for (int i = 0; i < numBlocks; ++i) {
+                        uint32_t samples = state.blockSamples[i];
+                        if (samples >= baseSamples && samples < numSamples && !state.blockConverged[i])
+                            state.blockConverged[i] = m_block.getRelativeError(state.blockOffsets[i], state.blockSizes[i])
+                                <= options.adaptiveThreshold;
+
+                        uint32_t limit = samples < baseSamples ? baseSamples : numSamples;
+                        passSamples[i] = state.blockConverged[i] ? 0 : std::min(samplesPerTask, limit - samples);
+                    }
+
+                    int numTasks = blockGenerator.beginPass(passSamples,
+                        coordinator ? std::max(coordinator->getConnectionCount(), 1) : threadCount);
+                    if (numTasks == 0)
+                        break;
+
+                    tbb::blocked_range<int> range(0, numTasks);
+
+                    auto renderLocal = [&](TileStorage &storage, uint32_t blockId) {
+                        ImageBlock &block = *storage.sampleBlock;
+                        ImageBlock &accumBlock = *storage.accumBlock;
+                        blockGenerator.getBlock(blockId, block);
+
+                        // Continue using the same sampler for the block
+                        uint32_t k0 = state.blockSamples[blockId];
+                        if(k0 == 0) { // Initialize the sampler for the first sample
                             std::unique_ptr<Sampler> sampler(m_scene->getSampler()->clone());
                             sampler->prepare(block);
-                            samplers.at(blockId) = std::move(sampler);
+                            state.samplers[blockId] = std::move(sampler);
                         }
 
-                        // Render all contained pixels
-                        renderBlock(m_scene, samplers.at(blockId).get(), block,m_progress);
-                        // The image block has been processed. Now add it to the "big" block that represents the entire image
-                        m_block.put(block);        
+                        ProfileZone zone("block", Profiler::isActive() ? tfm::format("block %i, samples %i-%i",
+                            blockId, k0, k0 + passSamples[blockId]) : "");
+                        Timer blockTimer;
+                        uint32_t k = renderSamples(m_scene, state.samplers[blockId].get(), block, accumBlock,
+                                                   k0, k0 + passSamples[blockId], numSamples, unbounded, stop,
+                                                   costImage.get());
 
-                        if (computeVariance) varianceBlock.put(block);
+                        // The samples of this block have been processed. Now add them to the "big" block that represents the entire image
+                        finishBlock(blockId, accumBlock, k0, k, blockTimer.elapsed());
+                    };
+
+                    auto map = [&](const tbb::blocked_range<int> &range) {
+                        TileStorage &storage = localStorage();
+                        for (int i = range.begin(); i < range.end(); ++i) {
+                            // Request the next task (the most expensive remaining blocks) from the block generator
+                            const uint32_t *begin, *end;
+                            if (!blockGenerator.next(begin, end))
+                                break;
+
+                            for (const uint32_t *it = begin; it != end; ++it)
+                                renderLocal(storage, *it);
+                        }
+                    };
+
+                    ProfileZone passZone("pass");
+                    if (coordinator) {
+                        std::vector<uint32_t> remaining;
+                        if (!coordinator->renderPass(blockGenerator, renderRemote, stop, remaining)) {
+                            /* Without any workers, the rest of the rendering continues locally */
+                            cerr << "Warning: lost all workers, rendering the remaining blocks locally" << endl;
+                            coordinator.reset();
+                            arena.execute([&] {
+                                tbb::parallel_for(tbb::blocked_range<size_t>(0, remaining.size()),
+                                    [&](const tbb::blocked_range<size_t> &range) {
+                                        TileStorage &storage = localStorage();
+                                        for (size_t i = range.begin(); i < range.end(); ++i)
+                                            renderLocal(storage, remaining[i]);
+                                    }, tbb::simple_partitioner());
+                            });
+                        }
+                    } else {
+                        /// Uncomment the following line for single threaded rendering
+                        //map(range);
+
+                        /// Default: parallel rendering (one task per iteration, since their costs differ widely)
+                        arena.execute([&] { tbb::parallel_for(range, map, tbb::simple_partitioner()); });
                     }
-                };
 
-                /// Uncomment the following line for single threaded rendering
-                //map(range);
+                    m_block.lock();
+                    for (int i = 0; i < numBlocks; ++i)
+                        if (hasBorder[i])
+                            m_block.putBorder(blockBorders[i]);
 
-                /// Default: parallel rendering
-                tbb::parallel_for(range, map);
+                    /* The moments of the pixels near the edges of a block depend on the samples of its neighbors */
+                    if (trackMoments && !counterBased) {
+                        std::vector<uint32_t> neighborIds;
+                        std::vector<const BlockBorder *> neighbors;
+                        for (int i = 0; i < numBlocks; ++i) {
+                            if (!hasBorder[i])
+                                continue;
+                            blockGenerator.getNeighbors((uint32_t) i, neighborIds);
+                            neighbors.clear();
+                            for (uint32_t id : neighborIds)
+                                if (hasBorder[id])
+                                    neighbors.push_back(&blockBorders[id]);
+                            m_block.putEdgeMoments(blockBorders[i], neighbors);
+                        }
+                    }
+                    std::fill(hasBorder.begin(), hasBorder.end(), 0);
+                    m_block.unlock();
+
+                    if (options.checkpointInterval > 0 && m_render_status != 2
+                            && checkpointTimer.elapsed() >= options.checkpointInterval * 1000.0)
+                        writeCheckpoint();
+
+                    ++passCount;
+                    if (m_render_status != 2 &&
+                        ((options.snapshotInterval > 0 && snapshotTimer.elapsed() >= options.snapshotInterval * 1000.0) ||
+                         (options.snapshotPasses > 0 && passCount % options.snapshotPasses == 0)))
+                        writeSnapshot();
+                }
+
+                /* The last snapshot must not replace the final image */
+                if (snapshotWriter.joinable())
+                    snapshotWriter.join();
+
+                cout << "done. (took " << timer.elapsedString() << ")" << endl;
+
+                double renderTime = elapsed();
+                if (budgetExhausted)
+                    cout << "Stopped after exhausting the time budget of " << timeString(timeBudget) << endl;
+                if (targetReached)
+                    cout << "Reached the target relative variance of " << options.targetVariance << endl;
+
+                /* The counters of a distributed rendering only cover the blocks rendered locally */
+                if (Statistics::isEnabled()) {
+                    Statistics::Summary summary = Statistics::getSummary();
+                    summary.renderTime = timer.elapsed() / 1000.0;
+                    cout << summary.toString();
+                    if (!options.statsName.empty()) {
+                        std::ofstream file(options.statsName);
+                        file << summary.toJSON();
+                        if (!file)
+                            cerr << "Warning: unable to write the statistics to \"" << options.statsName << "\"" << endl;
+                    }
+                } else if (!options.statsName.empty()) {
+                    cerr << "Warning: Nori was built without statistics (NORI_ENABLE_STATS), \""
+                         << options.statsName << "\" is not written" << endl;
+                }
+
+                /* Determine the number of samples per pixel that was actually achieved */
+                uint64_t pixelSamples = 0;
+                uint32_t minSamples = std::numeric_limits<uint32_t>::max(), maxSamples = 0;
+                int converged = 0;
+                for (int i = 0; i < numBlocks; ++i) {
+                    pixelSamples += (uint64_t) state.blockSamples[i] * state.blockSizes[i].prod();
+                    minSamples = std::min(minSamples, state.blockSamples[i]);
+                    maxSamples = std::max(maxSamples, state.blockSamples[i]);
+                    converged += state.blockConverged[i] ? 1 : 0;
+                }
+                double averageSamples = pixelSamples / (double) cropSize.prod();
+
+                if (options.adaptive)
+                    cout << tfm::format("Adaptive sampling: %i of %i blocks converged", converged, numBlocks) << endl;
+                if (options.adaptive || options.isProgressive())
+                    cout << tfm::format("Rendered %.1f samples per pixel on average (min: %i, max: %i)",
+                        averageSamples, minSamples, maxSamples) << endl;
+
+                Bitmap::Metadata metadata;
+                metadata["spp"] = tfm::format("%.6g", averageSamples);
+                metadata["sppMin"] = tfm::format("%i", minSamples);
+                metadata["sppMax"] = tfm::format("%i", maxSamples);
+                metadata["renderTime"] = tfm::format("%.3f", renderTime / 1000.0);
+                metadata["seed"] = tfm::format("%i", m_scene->getSampler()->getSeed());
+
+                /* All pixels of a block have the same sample count. The counts are
+                   stored in the order of the block IDs (row by row) for nori-merge */
+                std::ostringstream blockSampleCounts;
+                for (int i = 0; i < numBlocks; ++i)
+                    blockSampleCounts << (i > 0 ? " " : "") << state.blockSamples[i];
+                metadata["blockSize"] = tfm::format("%i", blockSize);
+                metadata["blockSampleCounts"] = blockSampleCounts.str();
+
+                ProfileZone writeZone("write output", outputName);
+
+                /* Now turn the rendered image block into
+                   a properly normalized bitmap */
+                m_block.lock();
+                std::unique_ptr<Bitmap> bitmap(m_block.toBitmap());
+                m_block.unlock();
+
+                /* Save using the OpenEXR format */
+                bitmap->save(outputName, metadata, cropOffset, outputSize);
 
                 if (computeVariance) {
-                    // Variance estimation (update sum and sumSquared)
-                    varianceBlock.lock();
-                    Bitmap bitmap{*varianceBlock.toBitmap()};
-                    varianceBlock.unlock();
-
-                    auto rows = bitmap.rows();
-                    auto columns = bitmap.cols();
-                    Color3f currentPixel;
-                    for (int y = 0; y < rows; y++) {    
-                        for (int x = 0; x < columns; x++) {    
-                            currentPixel = bitmap(y, x);
-                            sumBitmap(y, x) += currentPixel;
-                            sumSquaredBitmap(y, x) += pow(currentPixel, 2);
-                        }
+                    // Variance estimation using "Bessel's correction"
+                    std::unique_ptr<Bitmap> varianceBitmap(m_block.toVarianceBitmap());
+                    varianceBitmap->save(varianceOutputName, metadata, cropOffset, outputSize);
+                }
+
+                if (costImage) {
+                    /* "<output>_cost.exr" next to "<output>.exr" */
+                    std::string costBaseName = outputName.substr(0, outputName.size() - 4);
+                    Bitmap::Metadata costMetadata = metadata;
+                    costMetadata["costUnit"] = "microseconds";
+                    costImage->toBitmap(costImage->time)->save(costBaseName + "_cost.exr", costMetadata, cropOffset, outputSize);
+                    if (Statistics::isEnabled()) {
+                        costMetadata["costUnit"] = "BVH node visits";
+                        costImage->toBitmap(costImage->traversal)->save(costBaseName + "_traversal.exr", costMetadata,
+                                                                         cropOffset, outputSize);
                     }
                 }
-                
 
-                blockGenerator.reset();
+                /* A completed rendering doesn't need its checkpoint anymore. Neither does one that
+                   exhausted its time budget, which a resumed rendering would only extend */
+                if (checkpointWriter.joinable())
+                    checkpointWriter.join();
+                if (options.checkpointInterval > 0 && (m_render_status != 2 || budgetExhausted))
+                    std::remove(checkpointName.c_str());
+            } catch (const std::exception &e) {
+                cerr << "Fatal error: " << e.what() << endl;
+                m_failed = true;
             }
 
-            cout << "done. (took " << timer.elapsedString() << ")" << endl;
-
-            /* Now turn the rendered image block into
-               a properly normalized bitmap */
-            m_block.lock();
-            std::unique_ptr<Bitmap> bitmap(m_block.toBitmap());
-            m_block.unlock();
-
-            /* Save using the OpenEXR format */
-            bitmap->save(outputName);
-
-            if (computeVariance) {
-                // Variance estimation
-                Bitmap varianceBitmap{camera->getOutputSize()};
-                auto rows = varianceBitmap.rows();
-                auto columns = varianceBitmap.cols();
-                float samplesFactor = numSamples * (numSamples - 1);
-                for (int y = 0; y < rows; y++) {
-                    for (int x = 0; x < columns; x++) {
-                        // var[p] = (sample variance) * 1/n = ((ss/n - (s/n)^2) * (n/(n-1))) * 1/n = (ss - s^2/n) / ((n-1) * n)
-                        varianceBitmap(y, x) = (sumSquaredBitmap(y, x) - (pow(sumBitmap(y, x), 2) / numSamples)) / samplesFactor;
+            if (checkpointWriter.joinable())
+                checkpointWriter.join();
+            if (snapshotWriter.joinable())
+                snapshotWriter.join();
+        };
+
+        /* Do the following in parallel and asynchronously */
+        m_render_status = 1;
+        m_failed = false;
+        traceGuard.filename.clear();
+        m_render_thread = std::thread([this, options, outputName, renderFrame] {
+            if (!options.traceName.empty())
+                Profiler::setThreadName("render");
+            if (!options.isSequence()) {
+                renderFrame(options, outputName + ".exr", outputName + "_variance.exr", outputName + ".checkpoint");
+            } else {
+                /* Render the frames back to back. Assets stay loaded, and the BVH
+                   is only rebuilt for frames in which shapes have moved */
+                Timer timer;
+                int frameCount = options.lastFrame - options.firstFrame + 1, framesRendered = 0;
+                int currentFrame = options.firstFrame;
+                uint32_t seed = m_scene->getSampler()->getSeed();
+                for (int frame = options.firstFrame; frame <= options.lastFrame; ++frame) {
+                    if (m_render_status == 2 || m_failed)
+                        break;
+                    std::string frameName = tfm::format("%s_%04i", outputName, frame);
+                    RenderOptions frameOptions = options;
+                    if (!options.statsName.empty()) {
+                        size_t lastdot = options.statsName.find_last_of(".");
+                        frameOptions.statsName = tfm::format("%s_%04i%s", options.statsName.substr(0, lastdot),
+                            frame, lastdot != std::string::npos ? options.statsName.substr(lastdot) : "");
+                    }
+
+                    /* When resuming a sequence, frames without a checkpoint are either
+                       complete (if their image exists) or haven't been started yet */
+                    if (options.resume) {
+                        frameOptions.resume = filesystem::path(frameName + ".checkpoint").exists();
+                        if (!frameOptions.resume && filesystem::path(frameName + ".exr").exists()) {
+                            cout << "Skipping frame " << frame << " (\"" << frameName << ".exr\" exists)" << endl;
+                            continue;
+                        }
+                    }
+
+                    cout << tfm::format("Frame %i (%i of %i)", frame, frame - options.firstFrame + 1, frameCount) << endl;
+                    if (frame != currentFrame) {
+                        try {
+                            /* Moved shapes also invalidate the data of the integrator */
+                            if (m_scene->setFrame((float) frame)) {
+                                ProfileZone zone("Integrator::preprocess");
+                                m_scene->getIntegrator()->preprocess(m_scene);
+                            }
+                        } catch (const std::exception &e) {
+                            cerr << "Fatal error: " << e.what() << endl;
+                            m_failed = true;
+                            break;
+                        }
+                        currentFrame = frame;
+                        m_block.lock();
+                        m_block.clear();
+                        m_block.unlock();
                     }
+
+                    /* Mix the frame into the seed, so that the noise of consecutive frames is uncorrelated */
+                    m_scene->getSampler()->setSeed(seed + (uint32_t) frame * 0x9e3779b9u);
+
+                    renderFrame(frameOptions, frameName + ".exr", frameName + "_variance.exr", frameName + ".checkpoint");
+                    if (m_render_status != 2 && !m_failed)
+                        framesRendered++;
                 }
-                
-                // Save variance bitmap
-                varianceBitmap.save(varianceOutputName);
+
+                double hours = timer.elapsed() / 3.6e6;
+                cout << tfm::format("Rendered %i of %i frames in %s (%.1f frames per hour)", framesRendered,
+                    frameCount, timer.elapsedString(), hours > 0 ? framesRendered / hours : 0.0) << endl;
             }
-            
 
             delete m_scene;
             m_scene = nullptr;
 
+            if (!options.traceName.empty())
+                Profiler::end(options.traceName);
+
             m_render_status = 3;
         });
 
+        return true;
     }
     else {
         delete root;
+        return false;
     }
 
 }
 
 
+void renderWorker(const std::string &address, int connectionCount) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw NoriException("Expected the address of the coordinator as \"host:port\", got \"%s\"!", address);
+    std::string host = address.substr(0, colon);
+    int port = toInt(address.substr(colon + 1));
+
+    /* The first connection tells which scene to load */
+    std::vector<Socket> connections;
+    connections.push_back(Socket::connect(host, port));
+    std::string message;
+    if (!connections[0].receive(message))
+        throw NoriException("The coordinator closed the connection");
+    RenderJob job;
+    job.deserialize(message);
+
+    filesystem::path path(job.sceneFilename);
+    getFileResolver()->prepend(path.parent_path());
+    std::unique_ptr<NoriObject> root(loadFromXML(job.sceneFilename));
+    if (root->getClassType() != NoriObject::EScene)
+        throw NoriException("\"%s\" is not a scene!", job.sceneFilename);
+    Scene *scene = static_cast<Scene *>(root.get());
+    if (job.sampleCount > 0)
+        scene->getSampler()->setSampleCount((size_t) job.sampleCount);
+    scene->getSampler()->setSeed(job.seed);
+    if (job.deterministic)
+        useDeterministicSampler(scene);
+    if (job.width > 0 && job.height > 0)
+        scene->getCamera()->setOutputSize(Vector2i(job.width, job.height));
+    scene->getCamera()->setCropWindow(job.cropOffset, job.cropSize);
+    scene->getIntegrator()->preprocess(scene);
+
+    for (int i = 1; i < connectionCount; ++i) {
+        connections.push_back(Socket::connect(host, port));
+        if (!connections.back().receive(message)) /* Same job as above */
+            throw NoriException("The coordinator closed the connection");
+    }
+
+    cout << "Rendering blocks for " << address << " (" << connectionCount << " connections) .. ";
+    cout.flush();
+    Timer timer;
+
+    const Camera *camera = scene->getCamera();
+    BlockGenerator blockGenerator(camera->getCropOffset(), camera->getCropSize(), job.blockSize);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (Socket &socket : connections) {
+        Socket *connection = &socket;
+        threads.emplace_back([&, connection] {
+            try {
+                ImageBlock block(Vector2i(job.blockSize), camera->getReconstructionFilter());
+                ImageBlock accumBlock(Vector2i(job.blockSize), camera->getReconstructionFilter(), job.trackMoments);
+                accumBlock.setDeferEdgeMoments(!scene->getSampler()->isCounterBased());
+                std::string message;
+                while (connection->receive(message)) {
+                    std::istringstream request(message, std::ios::in | std::ios::binary);
+                    uint8_t type;
+                    readValue(request, type);
+                    if (type == RenderJob::EQuit)
+                        break;
+
+                    uint32_t blockId, k0, k1;
+                    uint8_t started;
+                    readValue(request, blockId);
+                    readValue(request, k0);
+                    readValue(request, k1);
+                    readValue(request, started);
+                    if (blockId >= (uint32_t) blockGenerator.getBlockCount())
+                        throw NoriException("Invalid block %i", blockId);
+                    blockGenerator.getBlock(blockId, block);
+
+                    std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+                    if (started)
+                        sampler->loadState(request);
+                    else
+                        sampler->prepare(block);
+
+                    Timer blockTimer;
+                    uint32_t k = renderSamples(scene, sampler.get(), block, accumBlock, k0, k1,
+                                               job.numSamples, job.unbounded, [] { return false; });
+
+                    std::ostringstream response(std::ios::out | std::ios::binary);
+                    writeValue(response, k);
+                    writeValue(response, blockTimer.elapsed());
+                    sampler->saveState(response);
+                    accumBlock.saveState(response);
+                    connection->send(response.str());
+                }
+            } catch (const std::exception &e) {
+                cerr << "Error: " << e.what() << endl;
+                failed = true;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    if (failed)
+        throw NoriException("Rendering for the coordinator failed");
+    cout << "done. (took " << timer.elapsedString() << ")" << endl;
+}
+
 NORI_NAMESPACE_END
\ No newline at end of file
@@ -25,8 +25,10 @@
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
+Scene::Scene(const PropertyList &props) {
     m_bvh = new BVH();
+    /* Memory-constrained renderings can do without the precomputed triangles of the BVH */
+    m_bvh->setPrecomputeTriangles(props.getBoolean("precomputeTriangles", true));
 }
 
 Scene::~Scene() {
@@ -59,6 +61,22 @@ void Scene::activate() {
     cout << endl;
 }
 
+void Scene::setSampler(Sampler *sampler) {
+    delete m_sampler;
+    m_sampler = sampler;
+}
+
+bool Scene::setFrame(float frame) {
+    m_camera->setFrame(frame);
+
+    bool changed = false;
+    for (Shape *shape : m_shapes)
+        changed |= shape->setFrame(frame);
+    if (changed)
+        m_bvh->rebuild();
+    return changed;
+}
+
 void Scene::addChild(NoriObject *obj) {
     switch (obj->getClassType()) {
         case EMesh: {
@@ -0,0 +1,194 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/socket.h>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+#if !defined(_WIN32)
+
+static NoriException socketError(const char *function) {
+    return NoriException("Socket::%s(): %s", function, std::strerror(errno));
+}
+
+Socket &Socket::operator=(Socket &&other) {
+    if (this != &other) {
+        close();
+        m_fd = other.m_fd;
+        other.m_fd = -1;
+    }
+    return *this;
+}
+
+Socket Socket::listen(int port) {
+    Socket socket(::socket(AF_INET, SOCK_STREAM, 0));
+    if (!socket.isValid())
+        throw socketError("listen");
+
+    int enable = 1;
+    setsockopt(socket.m_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((uint16_t) port);
+
+    if (::bind(socket.m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(socket.m_fd, SOMAXCONN) != 0)
+        throw socketError("listen");
+    return socket;
+}
+
+Socket Socket::connect(const std::string &host, int port) {
+    addrinfo hints, *result = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int error = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+    if (error != 0)
+        throw NoriException("Socket::connect(): unable to resolve \"%s\": %s", host, gai_strerror(error));
+
+    Socket socket(::socket(result->ai_family, result->ai_socktype, result->ai_protocol));
+    if (!socket.isValid() || ::connect(socket.m_fd, result->ai_addr, result->ai_addrlen) != 0) {
+        freeaddrinfo(result);
+        throw socketError("connect");
+    }
+    freeaddrinfo(result);
+
+    /* Messages are request/response pairs, so don't wait for more data */
+    int enable = 1;
+    setsockopt(socket.m_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return socket;
+}
+
+/// Fill in the address of a Unix domain socket
+static sockaddr_un localAddress(const std::string &path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw NoriException("The socket path \"%s\" is too long!", path);
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+Socket Socket::listenLocal(const std::string &path) {
+    sockaddr_un address = localAddress(path);
+    Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (!socket.isValid() ||
+        ::bind(socket.m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(socket.m_fd, SOMAXCONN) != 0)
+        throw socketError("listenLocal");
+    return socket;
+}
+
+Socket Socket::connectLocal(const std::string &path) {
+    sockaddr_un address = localAddress(path);
+    Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (!socket.isValid() ||
+        ::connect(socket.m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        throw socketError("connectLocal");
+    return socket;
+}
+
+Socket Socket::accept() {
+    int fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd < 0) {
+        if (errno == EINVAL || errno == EBADF)
+            return Socket(); /* The socket was shut down */
+        throw socketError("accept");
+    }
+
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return Socket(fd);
+}
+
+/// Transfer exactly \c size bytes, return \c false if the connection was closed
+static bool transfer(int fd, char *data, size_t size, bool sending) {
+    while (size > 0) {
+        ssize_t count = sending ? ::send(fd, data, size, MSG_NOSIGNAL) : ::recv(fd, data, size, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data += count;
+        size -= (size_t) count;
+    }
+    return true;
+}
+
+void Socket::send(const std::string &message) {
+    uint64_t size = message.size();
+    if (!transfer(m_fd, reinterpret_cast<char *>(&size), sizeof(size), true) ||
+        !transfer(m_fd, const_cast<char *>(message.data()), message.size(), true))
+        throw NoriException("Socket::send(): the connection was closed");
+}
+
+bool Socket::receive(std::string &message) {
+    uint64_t size;
+    if (!transfer(m_fd, reinterpret_cast<char *>(&size), sizeof(size), false))
+        return false;
+    message.resize((size_t) size);
+    if (!transfer(m_fd, &message[0], message.size(), false))
+        throw NoriException("Socket::receive(): the connection was closed during a message");
+    return true;
+}
+
+void Socket::shutdown() {
+    if (isValid())
+        ::shutdown(m_fd, SHUT_RDWR);
+}
+
+void Socket::close() {
+    if (isValid()) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+#else
+
+Socket &Socket::operator=(Socket &&other) { std::swap(m_fd, other.m_fd); return *this; }
+Socket Socket::listen(int) { throw NoriException("Sockets are not supported on this platform!"); }
+Socket Socket::connect(const std::string &, int) { throw NoriException("Sockets are not supported on this platform!"); }
+Socket Socket::listenLocal(const std::string &) { throw NoriException("Sockets are not supported on this platform!"); }
+Socket Socket::connectLocal(const std::string &) { throw NoriException("Sockets are not supported on this platform!"); }
+Socket Socket::accept() { return Socket(); }
+void Socket::send(const std::string &) { }
+bool Socket::receive(std::string &) { return false; }
+void Socket::shutdown() { }
+void Socket::close() { }
+
+#endif
+
+NORI_NAMESPACE_END
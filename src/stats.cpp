@@ -0,0 +1,171 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/stats.h>
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/* Counters of all threads that have rendered so far. They are never
+   released, since TBB's worker threads live until the process exits */
+static std::mutex statsMutex;
+static std::vector<Statistics::Counters *> statsThreads;
+static std::vector<std::string> statsShapeTypes;
+
+bool Statistics::isEnabled() {
+#if defined(NORI_STATS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+Statistics::Counters *Statistics::registerThread() {
+    Counters *counters = new Counters();
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsThreads.push_back(counters);
+    return counters;
+}
+
+uint32_t Statistics::getShapeType(const std::type_info &type) {
+    std::string name = type.name();
+#if defined(__GNUG__)
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (status == 0 && demangled)
+        name = demangled;
+    free(demangled);
+#endif
+    /* Strip "class " (MSVC) and the namespace */
+    size_t separator = name.find_last_of(": ");
+    if (separator != std::string::npos)
+        name = name.substr(separator + 1);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto it = std::find(statsShapeTypes.begin(), statsShapeTypes.end(), name);
+    if (it != statsShapeTypes.end())
+        return (uint32_t) (it - statsShapeTypes.begin());
+    if (statsShapeTypes.size() == MaxShapeTypes - 1) {
+        /* Count all further types together */
+        statsShapeTypes.push_back("Other");
+    }
+    if (statsShapeTypes.size() >= MaxShapeTypes)
+        return MaxShapeTypes - 1;
+    statsShapeTypes.push_back(name);
+    return (uint32_t) statsShapeTypes.size() - 1;
+}
+
+void Statistics::reset() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (Counters *counters : statsThreads)
+        *counters = Counters();
+}
+
+Statistics::Summary Statistics::getSummary() {
+    Summary summary;
+    static_cast<Counters &>(summary) = Counters();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (const Counters *counters : statsThreads) {
+        for (int i = 0; i < ECounterCount; ++i)
+            summary.counters[i] += counters->counters[i];
+        for (int i = 0; i < MaxShapeTypes; ++i)
+            summary.shapeTests[i] += counters->shapeTests[i];
+        for (int i = 0; i <= MaxPathLength; ++i)
+            summary.pathLengths[i] += counters->pathLengths[i];
+    }
+    summary.shapeTypes = statsShapeTypes;
+    return summary;
+}
+
+const char *Statistics::getName(ECounter counter) {
+    switch (counter) {
+        case ECameraRays:        return "cameraRays";
+        case EIntersectionRays:  return "intersectionRays";
+        case EShadowRays:        return "shadowRays";
+        case EBVHNodeVisits:     return "bvhNodeVisits";
+        case EPrimitiveTests:    return "primitiveTests";
+        case EMediumSampleSteps: return "mediumSampleSteps";
+        case EMediumTrSteps:     return "mediumTrSteps";
+        case EPaths:             return "paths";
+        case ERussianRoulette:   return "russianRouletteTerminations";
+        default:                 return "<unknown>";
+    }
+}
+
+std::string Statistics::Summary::toString() const {
+    auto perRay = [&](uint64_t value) {
+        uint64_t rays = counters[EIntersectionRays] + counters[EShadowRays];
+        return rays > 0 ? value / (double) rays : 0.0;
+    };
+    auto perSecond = [&](uint64_t value) {
+        return renderTime > 0 ? value / renderTime * 1e-6 : 0.0;
+    };
+
+    std::ostringstream oss;
+    oss << "Statistics:" << endl;
+    oss << tfm::format("  Camera rays            : %i (%.2f M/s)", counters[ECameraRays], perSecond(counters[ECameraRays])) << endl;
+    oss << tfm::format("  Intersection rays      : %i (%.2f M/s)", counters[EIntersectionRays], perSecond(counters[EIntersectionRays])) << endl;
+    oss << tfm::format("  Shadow rays            : %i (%.2f M/s)", counters[EShadowRays], perSecond(counters[EShadowRays])) << endl;
+    oss << tfm::format("  BVH node visits        : %i (%.2f per ray)", counters[EBVHNodeVisits], perRay(counters[EBVHNodeVisits])) << endl;
+    oss << tfm::format("  Primitive tests        : %i (%.2f per ray)", counters[EPrimitiveTests], perRay(counters[EPrimitiveTests])) << endl;
+    for (size_t i = 0; i < shapeTypes.size(); ++i)
+        oss << tfm::format("    %-20s : %i", shapeTypes[i], shapeTests[i]) << endl;
+    oss << tfm::format("  Medium sample steps    : %i", counters[EMediumSampleSteps]) << endl;
+    oss << tfm::format("  Medium Tr steps        : %i", counters[EMediumTrSteps]) << endl;
+
+    uint64_t paths = counters[EPaths], bounces = 0;
+    for (int i = 0; i <= MaxPathLength; ++i)
+        bounces += (uint64_t) i * pathLengths[i];
+    oss << tfm::format("  Paths                  : %i (%.2f bounces on average)", paths,
+                       paths > 0 ? bounces / (double) paths : 0.0) << endl;
+    oss << tfm::format("  Russian roulette       : %i (%.1f%% of the paths)", counters[ERussianRoulette],
+                       paths > 0 ? 100.0 * counters[ERussianRoulette] / paths : 0.0) << endl;
+    oss << "  Path length histogram  :";
+    for (int i = 0; i <= MaxPathLength; ++i)
+        if (pathLengths[i] > 0)
+            oss << " " << i << (i == MaxPathLength ? "+" : "") << ":" << pathLengths[i];
+    oss << endl;
+    return oss.str();
+}
+
+std::string Statistics::Summary::toJSON() const {
+    std::ostringstream oss;
+    oss << "{" << endl;
+    oss << tfm::format("  \"renderTime\": %.3f,", renderTime) << endl;
+    for (int i = 0; i < ECounterCount; ++i)
+        oss << tfm::format("  \"%s\": %i,", getName((ECounter) i), counters[i]) << endl;
+    oss << "  \"shapeTests\": {";
+    for (size_t i = 0; i < shapeTypes.size(); ++i)
+        oss << (i > 0 ? ", " : "") << tfm::format("\"%s\": %i", shapeTypes[i], shapeTests[i]);
+    oss << "}," << endl;
+    oss << "  \"pathLengths\": [";
+    for (int i = 0; i <= MaxPathLength; ++i)
+        oss << (i > 0 ? ", " : "") << pathLengths[i];
+    oss << "]" << endl;
+    oss << "}" << endl;
+    return oss.str();
+}
+
+NORI_NAMESPACE_END
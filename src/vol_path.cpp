@@ -3,6 +3,7 @@
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
 #include <nori/medium.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -23,6 +24,7 @@ public:
         float successProbability;
         auto wMat = 1.0f;
         auto wEm = 0.0f;
+        NORI_STATS_ONLY(int bounces = 0);
 
         bool sceneIntersection = scene->rayIntersect(recursiveRay, its);
         auto allMedia = scene->getMedia();
@@ -42,9 +44,11 @@ public:
                 // Russian Roulette
                 successProbability = std::min(t.maxCoeff(), 0.99f);
                 if (sampler->next1D() > successProbability) {
+                    NORI_STATS_ADD(ERussianRoulette, 1);
                     break;
                 }
                 t /= successProbability;
+                NORI_STATS_ONLY(bounces++);
                 t *= albedo;
 
                 Vector3f wo;
@@ -98,9 +102,11 @@ public:
                 // Russian Roulette
                 successProbability = std::min(t.maxCoeff(), 0.99f);
                 if (sampler->next1D() > successProbability) {
+                    NORI_STATS_ADD(ERussianRoulette, 1);
                     break;
                 }
                 t /= successProbability;
+                NORI_STATS_ONLY(bounces++);
 
                 // Contribution from emitter sampling
                 auto randomEmitter = scene->getRandomEmitter(sampler->next1D());
@@ -152,6 +158,7 @@ public:
             }
         }
 
+        NORI_STATS_PATH_LENGTH(bounces);
         return Li;
     }
 